@@ -0,0 +1,100 @@
+/*
+ * bench-trans.c - Times the registered transpose functions on the real
+ *     machine, using the shared harness in bench/
+ *
+ * test-trans counts the misses of a transpose function in the simulated
+ * cache (s = 5, E = 1, b = 5); this measures how long it takes on the
+ * hardware, for each of the three graded matrix sizes. With -c the
+ * caches are cleared before every sample, so the matrices start out in
+ * memory as they do under the simulator.
+ *
+ * Usage: bench-trans [harness flags] (see bench-trans -h)
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cachelab.h"
+#include "bench.h"
+
+/* External function defined in trans.c */
+extern void registerFunctions();
+
+/* External variables defined in cachelab.c */
+extern trans_func_t func_list[MAX_TRANS_FUNCS];
+extern int func_counter;
+
+/* The graded matrix sizes */
+static const int sizes[][2] = {{32, 32}, {64, 64}, {61, 67}};
+#define NSIZES (sizeof(sizes) / sizeof(sizes[0]))
+
+static int A[256][256];
+static int B[256][256];
+
+/* One benchmark: a transpose function on one matrix size */
+typedef struct {
+    int func;
+    int M;
+    int N;
+    char name[64];
+} trans_bench_t;
+
+static trans_bench_t benches[MAX_TRANS_FUNCS * NSIZES];
+
+/* run_trans - Transpose the M x N matrix A into B with one function */
+static void run_trans(void *argp)
+{
+    trans_bench_t *t = argp;
+
+    (*func_list[t->func].func_ptr)(t->M, t->N, (void *)A, (void *)B);
+}
+
+/* is_correct - Does function func transpose an M x N matrix correctly? */
+static int is_correct(int func, int M, int N)
+{
+    static int C[256][256];
+    int (*a)[M] = (void *)A;
+    int (*b)[N] = (void *)B;
+    int (*c)[N] = (void *)C;
+    int i, j;
+
+    initMatrix(M, N, a, b);
+    (*func_list[func].func_ptr)(M, N, a, b);
+    correctTrans(M, N, a, c);
+    for (i = 0; i < M; i++)
+        for (j = 0; j < N; j++)
+            if (b[i][j] != c[i][j])
+                return 0;
+    return 1;
+}
+
+int main(int argc, char *argv[])
+{
+    int f, n = 0;
+    size_t s;
+
+    if (bench_options(argc, argv, "") != argc) {
+        bench_usage(argv[0], "");
+        exit(1);
+    }
+
+    registerFunctions();
+    for (f = 0; f < func_counter; f++) {
+        printf("Function %d: %s\n", f, func_list[f].description);
+        for (s = 0; s < NSIZES; s++) {
+            trans_bench_t *t = &benches[n];
+
+            t->func = f;
+            t->M = sizes[s][0];
+            t->N = sizes[s][1];
+            if (!is_correct(f, t->M, t->N)) {
+                printf("Function %d is wrong for %dx%d; not timed\n",
+                       f, t->M, t->N);
+                continue;
+            }
+            snprintf(t->name, sizeof(t->name), "func %d %dx%d", f, t->M, t->N);
+            bench_add(t->name, NULL, run_trans, t, t->M * t->N);
+            n++;
+        }
+    }
+    return bench_run();
+}
@@ -0,0 +1,50 @@
+/*
+ * btrace.h - binary trace format, written by rep2bin and read by mdriver
+ *
+ * A binary trace holds the same requests as a .rep file, but mdriver can
+ * map it and decode it in one pass instead of scanning text. It is a
+ * btrace_hdr_t followed by data_len bytes of encoded requests. Each
+ * request is a type byte (BTRACE_xxx) followed by unsigned LEB128
+ * varints (7 bits per byte, low bits first, high bit set on all but the
+ * last byte):
+ *
+ *     BTRACE_ALLOC        id size
+ *     BTRACE_REALLOC      id size
+ *     BTRACE_FREE         id
+ *     BTRACE_MEMALIGN     id align size
+ *     BTRACE_BATCH_ALLOC  id n size
+ *     BTRACE_BATCH_FREE   id n
+ *
+ * Every id is stored as the zigzag-encoded difference from the previous
+ * request's id, which keeps it to a byte or two in most traces. The
+ * header is written in host byte order; a file from a machine of the
+ * other endianness fails the magic number check.
+ */
+#include <stdint.h>
+
+#define BTRACE_MAGIC   0x4254444d   /* "MDTB" */
+#define BTRACE_VERSION 1
+
+/* Request types */
+#define BTRACE_ALLOC       1
+#define BTRACE_REALLOC     2
+#define BTRACE_FREE        3
+#define BTRACE_MEMALIGN    4
+#define BTRACE_BATCH_ALLOC 5
+#define BTRACE_BATCH_FREE  6
+
+typedef struct {
+    uint32_t magic;         /* BTRACE_MAGIC */
+    uint32_t version;       /* BTRACE_VERSION */
+    int32_t weight;         /* the four .rep header fields */
+    int32_t num_ids;
+    int32_t num_ops;
+    int32_t ignore_ranges;
+    int32_t num_reqs;       /* allocator calls, counting batches in full */
+    uint32_t reserved;      /* zero */
+    uint64_t data_len;      /* bytes of requests after the header */
+} btrace_hdr_t;
+
+/* zigzag maps small negative and positive differences to small codes */
+#define ZIGZAG(d)   (((uint64_t)(d) << 1) ^ (uint64_t)((int64_t)(d) >> 63))
+#define UNZIGZAG(u) ((int64_t)((u) >> 1) ^ -(int64_t)((u) & 1))
@@ -11,7 +11,11 @@
 #include <string.h>
 #include <unistd.h>
 #include <sys/times.h>
+#include <time.h>
 #include "clock.h"
+#if defined(__i386__) || defined(__x86_64__)
+#include <cpuid.h>
+#endif
 
 
 /******************************************************* 
@@ -295,3 +299,112 @@ double get_comp_counter()
     return ctime;
 }
 
+/** Invariant TSC routines, falling back to clock_gettime */
+
+/*
+ * A TSC that is invariant ticks at one constant rate whatever the core
+ * clock does and in every power state, so it measures wall time. Where
+ * it is not invariant, or rdtscp is missing, the same calls read
+ * CLOCK_MONOTONIC_RAW instead. The fences keep the timed code from being
+ * reordered across either read: nothing after start_tsc starts before
+ * its read, and rdtscp waits for everything before get_tsc to finish.
+ */
+static int tsc_ok = 0;             /* invariant TSC with rdtscp found */
+static double tsc_ns_per_tick = 1; /* TSC ticks, or ns on the fallback */
+static unsigned long long tsc_start = 0;
+
+static double now_ns(void)
+{
+    struct timespec ts;
+
+#ifdef CLOCK_MONOTONIC_RAW
+    clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+#else
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+#endif
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+#if defined(__i386__) || defined(__x86_64__)
+static inline unsigned long long tsc_begin(void)
+{
+    unsigned lo, hi;
+
+    asm volatile("lfence; rdtsc; lfence" : "=a" (lo), "=d" (hi) :: "memory");
+    return ((unsigned long long)hi << 32) | lo;
+}
+
+static inline unsigned long long tsc_end(void)
+{
+    unsigned lo, hi, aux;
+
+    asm volatile("rdtscp; lfence" : "=a" (lo), "=d" (hi), "=c" (aux) ::
+                 "memory");
+    return ((unsigned long long)hi << 32) | lo;
+}
+
+/* CPUID.80000007H:EDX[8] is invariant TSC, 80000001H:EDX[27] rdtscp */
+static int have_invariant_tsc(void)
+{
+    unsigned a, b, c, d;
+
+    if (!__get_cpuid(0x80000001, &a, &b, &c, &d) || !(d & (1u << 27)))
+        return 0;
+    return __get_cpuid(0x80000007, &a, &b, &c, &d) && (d & (1u << 8));
+}
+#else
+static inline unsigned long long tsc_begin(void) { return now_ns(); }
+static inline unsigned long long tsc_end(void) { return now_ns(); }
+static int have_invariant_tsc(void) { return 0; }
+#endif
+
+/* Calibrate the TSC against CLOCK_MONOTONIC_RAW; returns 1 if the TSC is
+   used, 0 if timing falls back to clock_gettime */
+int init_tsc(int verbose)
+{
+    unsigned long long t0, t1;
+    double ns0, ns1;
+
+    if (!(tsc_ok = have_invariant_tsc())) {
+        tsc_ns_per_tick = 1;
+        if (verbose)
+            printf("No invariant TSC; timing with clock_gettime().\n");
+        return 0;
+    }
+
+    /* Count ticks over about 50 ms, reading the clock between two reads
+       of the TSC at each end so that the clock read's own time cancels */
+    t0 = tsc_begin();
+    ns0 = now_ns();
+    t0 = (t0 + tsc_end()) / 2;
+    do {
+        t1 = tsc_begin();
+        ns1 = now_ns();
+        t1 = (t1 + tsc_end()) / 2;
+    } while (ns1 - ns0 < 5e7);
+    tsc_ns_per_tick = (ns1 - ns0) / (double)(t1 - t0);
+    if (verbose)
+        printf("Invariant TSC at %.1f MHz (calibrated against "
+               "CLOCK_MONOTONIC_RAW).\n", tsc_mhz());
+    return 1;
+}
+
+/* TSC rate in MHz as calibrated by init_tsc (0 if not in use) */
+double tsc_mhz(void)
+{
+    return tsc_ok ? 1e3 / tsc_ns_per_tick : 0;
+}
+
+/* Record the time */
+void start_tsc(void)
+{
+    tsc_start = tsc_ok ? tsc_begin() : (unsigned long long)now_ns();
+}
+
+/* Seconds since the last start_tsc */
+double get_tsc(void)
+{
+    unsigned long long t = tsc_ok ? tsc_end() : (unsigned long long)now_ns();
+
+    return (t - tsc_start) * tsc_ns_per_tick * 1e-9;
+}
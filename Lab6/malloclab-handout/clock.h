@@ -20,3 +20,18 @@ double mhz_full(int verbose, int sleeptime);
 void start_comp_counter();
 
 double get_comp_counter();
+
+/** Invariant TSC timing, with a clock_gettime fallback */
+
+/* Calibrate the TSC against CLOCK_MONOTONIC_RAW; returns 1 if the TSC is
+   used, 0 if timing falls back to clock_gettime */
+int init_tsc(int verbose);
+
+/* TSC rate in MHz as calibrated by init_tsc (0 if not in use) */
+double tsc_mhz(void);
+
+/* Record the time */
+void start_tsc(void);
+
+/* Seconds since the last start_tsc */
+double get_tsc(void);
@@ -31,6 +31,8 @@
     "alaska.rep", \
     "amptjp.rep", \
     "bash.rep", \
+    "batch.rep", \
+    "batch-single.rep", \
     "boat.rep",\
     "cccp.rep", \
     "chrome.rep", \
@@ -47,6 +49,7 @@
     "ls.rep", \
     "malloc.rep", \
     "malloc-free.rep", \
+    "memalign.rep", \
     "nlydf.rep", \
     "perl.rep", \
     "qyqyc.rep", \
@@ -55,7 +58,19 @@
     "rm.rep", \
     "rulsr.rep",\
     "seglist.rep", \
-    "short2.rep"
+    "short2.rep" \
+    WIDE_TRACEFILES
+
+/*
+ * Traces with blocks and heaps over 4 GB, only run by wide builds
+ */
+#ifdef MM_WIDE
+#define WIDE_TRACEFILES , \
+    "huge-blocks.rep", \
+    "huge-mixed.rep"
+#else
+#define WIDE_TRACEFILES
+#endif
 
 /*
  * If this is uncommented, then use "alt grading", in which
@@ -105,15 +120,22 @@
 #define ALIGNMENT 8
 
 /*
- * Maximum heap size in bytes
+ * Maximum heap size in bytes. memlib only reserves this much address
+ * space and commits it as the heap grows. Wide builds (-DMM_WIDE, see
+ * mdriver-wide) use 64-bit block sizes and get a much larger heap.
  */
+#ifdef MM_WIDE
+#define MAX_HEAP (64UL<<30)     /* 64 GB */
+#else
 #define MAX_HEAP (100*(1<<20))  /* 100 MB */
+#endif
 
 /*****************************************************************************
  * Set exactly one of these USE_xxx constants to "1" to select a timing method
  *****************************************************************************/
 #define USE_FCYC   0   /* cycle counter w/K-best scheme (x86 & Alpha only) */
+#define USE_TSC    1   /* invariant TSC w/K-best median, else clock_gettime */
 #define USE_ITIMER 0   /* interval timer (any Unix box) */
-#define USE_GETTOD 1   /* gettimeofday (any Unix box) */
+#define USE_GETTOD 0   /* gettimeofday (any Unix box) */
 
 #endif /* __CONFIG_H */
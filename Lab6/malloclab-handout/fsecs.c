@@ -9,6 +9,7 @@
 #include "config.h"
 
 static double Mhz;  /* estimated CPU clock frequency */
+static double spread;   /* of the k best runs of the last fsecs */
 
 extern int verbose; /* -v option in mdriver.c */
 
@@ -29,7 +30,12 @@ void init_fsecs(void)
     set_fcyc_compensate(1);
     set_fcyc_epsilon(0.01);
     set_fcyc_k(3);
-    Mhz = mhz(verbose > 0);
+    /* rdtsc counts at the invariant TSC rate, not the core clock */
+    Mhz = init_tsc(0) ? tsc_mhz() : mhz(verbose > 0);
+#elif USE_TSC
+    if (verbose)
+	printf("Measuring performance with the TSC, median of K-best.\n");
+    init_tsc(verbose);
 #elif USE_ITIMER
     if (verbose)
 	printf("Measuring performance with the interval timer.\n");
@@ -47,6 +53,8 @@ double fsecs(fsecs_test_funct f, void *argp)
 #if USE_FCYC
     double cycles = fcyc(f, argp);
     return cycles/(Mhz*1e6);
+#elif USE_TSC
+    return ftimer_tsc(f, argp, 5, 20, 0.02, &spread);
 #elif USE_ITIMER
     return ftimer_itimer(f, argp, 10);
 #elif USE_GETTOD
@@ -54,4 +62,11 @@ double fsecs(fsecs_test_funct f, void *argp)
 #endif 
 }
 
-
+/*
+ * fsecs_spread - Half the spread of the k best runs behind the last fsecs
+ * result, as a share of it, or 0 if the timer does not give one
+ */
+double fsecs_spread(void)
+{
+    return spread;
+}
@@ -7,10 +7,13 @@
  * Function timers that estimate the running time (in seconds) of a function f.
  *    ftimer_itimer: version that uses the interval timer
  *    ftimer_gettod: version that uses gettimeofday
+ *    ftimer_tsc: version that uses the invariant TSC (see clock.c)
  */
 #include <stdio.h>
 #include <sys/time.h>
 #include "ftimer.h"
+#include "clock.h"
+#include "kbest.h"
 
 /* function prototypes */
 static void init_etime(void);
@@ -53,6 +56,35 @@ double ftimer_gettod(ftimer_test_funct f, void *argp, int n)
 }
 
 
+/* 
+ * ftimer_tsc - Use the TSC to estimate the running time of f(argp) by
+ * the K-best scheme (see kbest.c): time single runs, after one to warm
+ * up, until the k fastest are within epsilon of each other or maxsamples
+ * runs are done. Return the median of the k fastest and set *spread to
+ * their half spread as a share of it.
+ */
+double ftimer_tsc(ftimer_test_funct f, void *argp, int k, int maxsamples,
+                  double epsilon, double *spread)
+{
+    double values[k], t;
+    kbest_t kb;
+    int i;
+
+    kbest_init(&kb, values, k, epsilon);
+    f(argp);
+    for (i = 0; i < maxsamples; i++) {
+        start_tsc();
+        f(argp);
+        t = get_tsc();
+        if (kbest_add(&kb, t))
+            break;
+    }
+
+    *spread = kbest_spread(&kb);
+    return kbest_median(&kb);
+}
+
+
 /*
  * Routines for manipulating the Unix interval timer
  */
@@ -12,3 +12,9 @@ double ftimer_itimer(ftimer_test_funct f, void *argp, int n);
    Return the average of n runs */
 double ftimer_gettod(ftimer_test_funct f, void *argp, int n);
 
+/* Estimate the running time of f(argp) using the invariant TSC, by the
+   K-best scheme. Return the median of the k fastest of at most
+   maxsamples runs, and set *spread to half the spread of those k as a
+   share of their median */
+double ftimer_tsc(ftimer_test_funct f, void *argp, int k, int maxsamples,
+                  double epsilon, double *spread);
@@ -0,0 +1,518 @@
+/*
+ * gentrace.c - Generate synthetic mdriver traces from workload models
+ *
+ * Usage: gentrace [-s <seed>] [-w <weight>] [-o <file.rep>] <phase>...
+ *
+ * A trace is a sequence of phases, each described by a list of
+ * key=value settings separated by commas:
+ *
+ *     n=<count>        allocations in the phase (default 10000)
+ *     size=<dist>      request sizes in bytes (default uniform:1:256)
+ *     life=<dist>      lifetime of a block, counted in allocations
+ *                      (default exp:1000)
+ *     grow=<p>:<f>:<k> a block is reallocated k times with probability p,
+ *                      growing by a factor of f each time (default none)
+ *     order=<o>        when blocks are freed (default life):
+ *                      life     when their lifetime runs out
+ *                      fifo:<b> producer/consumer: blocks come in bursts
+ *                               of b, and each burst is freed in the order
+ *                               it was allocated once the next is made
+ *                      lifo:<b> bursts of b freed in reverse order
+ *     drain=<0|1>      free all live blocks when the phase ends (default 0,
+ *                      so that long-lived blocks outlast the phase)
+ *
+ * and a distribution is one of
+ *
+ *     uniform:<lo>:<hi>       uniform on lo..hi
+ *     exp:<mean>              exponential
+ *     zipf:<s>:<max>[:<unit>] unit*k for k in 1..max, P(k) ~ k^-s
+ *     bimodal:<a>:<b>:<p>     a with probability p, otherwise b
+ *     lognormal:<mu>:<sigma>  exp(mu + sigma*N(0,1))
+ *     forever                 (lifetimes only) never freed before the end
+ *
+ * For example, a phase of small short-lived strings followed by one of
+ * growing buffers:
+ *
+ *     gentrace -s 1 n=50000,size=zipf:1.2:64:8,life=exp:200 \
+ *              n=2000,size=lognormal:8:1,grow=0.5:2:6,life=uniform:10:500
+ *
+ * The generator has its own random number generator (splitmix64), so a
+ * seed gives the same trace on every machine. Block ids are recycled
+ * once freed, and every block still live at the end is freed.
+ */
+#include <errno.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define MAX_SIZE  ((size_t)1 << 30)     /* largest request we generate */
+#define MAX_ZIPF  (1 << 24)             /* largest zipf rank */
+
+/* A distribution */
+typedef struct {
+    enum { D_UNIFORM, D_EXP, D_ZIPF, D_BIMODAL, D_LOGNORMAL, D_FOREVER } kind;
+    double a, b, c;
+    double *cdf;            /* zipf only: cumulative probabilities */
+    int n;                  /* zipf only: number of ranks */
+} dist_t;
+
+/* One phase of the workload */
+typedef struct {
+    int n;
+    dist_t size;
+    dist_t life;
+    double grow_p, grow_f;
+    int grow_k;
+    enum { O_LIFE, O_FIFO, O_LIFO } order;
+    int burst;
+    int drain;
+} phase_t;
+
+/* One request in the output trace */
+typedef struct {
+    char type;              /* 'a', 'r' or 'f' */
+    int id;
+    size_t size;
+} op_t;
+
+/* A pending free or realloc, ordered by time */
+typedef struct {
+    uint64_t time;
+    uint64_t seq;           /* breaks ties in the order events were made */
+    int id;
+    double grow;            /* realloc by this factor, or 0 to free */
+} event_t;
+
+static uint64_t rng_state;
+
+static op_t *ops;
+static size_t nops, ops_cap;
+
+static event_t *events;     /* binary min-heap */
+static size_t nevents, events_cap;
+static uint64_t event_seq;
+
+static int *free_ids;       /* stack of ids that can be reused */
+static int nfree_ids, free_ids_cap;
+static int num_ids;
+
+static size_t *cur_size;    /* current size of each live id, or 0 */
+static int cur_size_cap;
+
+static void app_error(const char *msg, const char *arg)
+{
+    fprintf(stderr, "gentrace: %s%s%s\n", msg, arg ? ": " : "",
+            arg ? arg : "");
+    exit(1);
+}
+
+static void *xrealloc(void *p, size_t size)
+{
+    if ((p = realloc(p, size)) == NULL)
+        app_error("out of memory", NULL);
+    return p;
+}
+
+/*
+ * rnd - Next 64 random bits (splitmix64)
+ */
+static uint64_t rnd(void)
+{
+    uint64_t z = (rng_state += 0x9e3779b97f4a7c15ULL);
+
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+/*
+ * unif - Uniform on [0, 1)
+ */
+static double unif(void)
+{
+    return (rnd() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static double normal(void)
+{
+    double u = unif(), v = unif();
+
+    return sqrt(-2.0 * log(1.0 - u)) * cos(2.0 * M_PI * v);
+}
+
+/*
+ * parse_dist - Parse a distribution spec such as "zipf:1.1:1024"
+ */
+static void parse_dist(dist_t *d, const char *spec)
+{
+    char name[16];
+    double x[3] = { 0, 0, 1 };
+    int n, i;
+    double sum;
+
+    n = sscanf(spec, "%15[a-z]:%lf:%lf:%lf", name, &x[0], &x[1], &x[2]);
+    if (n < 1)
+        app_error("bad distribution", spec);
+    d->a = x[0];
+    d->b = x[1];
+    d->c = x[2];
+    d->cdf = NULL;
+    if (!strcmp(name, "uniform") && n == 3 && x[0] <= x[1] && x[0] >= 0) {
+        d->kind = D_UNIFORM;
+    } else if (!strcmp(name, "exp") && n == 2 && x[0] > 0) {
+        d->kind = D_EXP;
+    } else if (!strcmp(name, "zipf") && (n == 3 || n == 4) && x[0] > 0 &&
+               x[1] >= 1 && x[1] <= MAX_ZIPF && x[2] >= 1) {
+        d->kind = D_ZIPF;
+        d->n = (int)x[1];
+        d->cdf = xrealloc(NULL, d->n * sizeof(double));
+        for (i = 0, sum = 0; i < d->n; i++)
+            d->cdf[i] = (sum += pow(i + 1, -x[0]));
+        for (i = 0; i < d->n; i++)
+            d->cdf[i] /= sum;
+    } else if (!strcmp(name, "bimodal") && n == 4 && x[2] >= 0 && x[2] <= 1) {
+        d->kind = D_BIMODAL;
+    } else if (!strcmp(name, "lognormal") && n == 3 && x[1] >= 0) {
+        d->kind = D_LOGNORMAL;
+    } else if (!strcmp(name, "forever") && n == 1) {
+        d->kind = D_FOREVER;
+    } else {
+        app_error("bad distribution", spec);
+    }
+}
+
+/*
+ * sample - Draw from d, rounded to an integer of at least 1
+ */
+static double sample(const dist_t *d)
+{
+    double x = 1, u;
+    int lo, hi, mid;
+
+    switch (d->kind) {
+    case D_UNIFORM:
+        x = d->a + floor(unif() * (d->b - d->a + 1));
+        break;
+    case D_EXP:
+        x = -d->a * log(1.0 - unif());
+        break;
+    case D_ZIPF:
+        u = unif();
+        for (lo = 0, hi = d->n - 1; lo < hi; ) {
+            mid = (lo + hi) / 2;
+            if (d->cdf[mid] <= u)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        x = (lo + 1) * d->c;
+        break;
+    case D_BIMODAL:
+        x = (unif() < d->c) ? d->a : d->b;
+        break;
+    case D_LOGNORMAL:
+        x = exp(d->a + d->b * normal());
+        break;
+    case D_FOREVER:
+        return INFINITY;
+    }
+    x = floor(x + 0.5);
+    return x < 1 ? 1 : x;
+}
+
+static size_t sample_size(const dist_t *d)
+{
+    double x = sample(d);
+
+    return x > MAX_SIZE ? MAX_SIZE : (size_t)x;
+}
+
+/*
+ * parse_phase - Parse a phase spec such as "n=1000,size=exp:64"
+ */
+static void parse_phase(phase_t *ph, char *spec)
+{
+    char *kv, *val, *save = NULL;
+
+    ph->n = 10000;
+    parse_dist(&ph->size, "uniform:1:256");
+    parse_dist(&ph->life, "exp:1000");
+    ph->grow_p = 0;
+    ph->grow_f = 1;
+    ph->grow_k = 0;
+    ph->order = O_LIFE;
+    ph->burst = 1;
+    ph->drain = 0;
+
+    for (kv = strtok_r(spec, ",", &save); kv; kv = strtok_r(NULL, ",", &save)) {
+        if ((val = strchr(kv, '=')) == NULL)
+            app_error("expected key=value", kv);
+        *val++ = '\0';
+        if (!strcmp(kv, "n")) {
+            if ((ph->n = atoi(val)) < 0)
+                app_error("bad count", val);
+        } else if (!strcmp(kv, "size")) {
+            parse_dist(&ph->size, val);
+            if (ph->size.kind == D_FOREVER)
+                app_error("sizes cannot be forever", val);
+        } else if (!strcmp(kv, "life")) {
+            parse_dist(&ph->life, val);
+        } else if (!strcmp(kv, "grow")) {
+            if (sscanf(val, "%lf:%lf:%d", &ph->grow_p, &ph->grow_f,
+                       &ph->grow_k) != 3 || ph->grow_p < 0 || ph->grow_p > 1 ||
+                ph->grow_f <= 0 || ph->grow_k < 0)
+                app_error("bad grow=<p>:<factor>:<times>", val);
+        } else if (!strcmp(kv, "order")) {
+            if (!strcmp(val, "life"))
+                ph->order = O_LIFE;
+            else if (sscanf(val, "fifo:%d", &ph->burst) == 1 && ph->burst > 0)
+                ph->order = O_FIFO;
+            else if (sscanf(val, "lifo:%d", &ph->burst) == 1 && ph->burst > 0)
+                ph->order = O_LIFO;
+            else
+                app_error("bad order", val);
+        } else if (!strcmp(kv, "drain")) {
+            ph->drain = atoi(val);
+        } else {
+            app_error("unknown phase setting", kv);
+        }
+    }
+}
+
+static void emit(char type, int id, size_t size)
+{
+    if (nops == ops_cap) {
+        ops_cap = ops_cap ? 2 * ops_cap : 1 << 16;
+        ops = xrealloc(ops, ops_cap * sizeof(*ops));
+    }
+    ops[nops++] = (op_t){ type, id, size };
+}
+
+/*
+ * Event heap, ordered by (time, seq)
+ */
+static int before(const event_t *x, const event_t *y)
+{
+    return x->time < y->time || (x->time == y->time && x->seq < y->seq);
+}
+
+static void push_event(uint64_t time, int id, double grow)
+{
+    size_t i = nevents++;
+    event_t e = { time, event_seq++, id, grow };
+
+    if (nevents > events_cap) {
+        events_cap = events_cap ? 2 * events_cap : 1 << 12;
+        events = xrealloc(events, events_cap * sizeof(*events));
+    }
+    for (; i > 0 && before(&e, &events[(i - 1) / 2]); i = (i - 1) / 2)
+        events[i] = events[(i - 1) / 2];
+    events[i] = e;
+}
+
+static event_t pop_event(void)
+{
+    event_t top = events[0], last = events[--nevents];
+    size_t i = 0, c;
+
+    while ((c = 2 * i + 1) < nevents) {
+        if (c + 1 < nevents && before(&events[c + 1], &events[c]))
+            c++;
+        if (!before(&events[c], &last))
+            break;
+        events[i] = events[c];
+        i = c;
+    }
+    events[i] = last;
+    return top;
+}
+
+/*
+ * new_block - Allocate a block of the given size, returning its id
+ */
+static int new_block(size_t size)
+{
+    int id;
+
+    if (nfree_ids > 0) {
+        id = free_ids[--nfree_ids];
+    } else {
+        id = num_ids++;
+        if (id == cur_size_cap) {
+            cur_size_cap = cur_size_cap ? 2 * cur_size_cap : 1 << 12;
+            cur_size = xrealloc(cur_size, cur_size_cap * sizeof(*cur_size));
+        }
+    }
+    cur_size[id] = size;
+    emit('a', id, size);
+    return id;
+}
+
+static void grow_block(int id, double factor)
+{
+    double size = ceil(cur_size[id] * factor);
+
+    if (cur_size[id] == 0)
+        return;
+    cur_size[id] = size < 1 ? 1 : size > MAX_SIZE ? MAX_SIZE : (size_t)size;
+    emit('r', id, cur_size[id]);
+}
+
+static void free_block(int id)
+{
+    if (cur_size[id] == 0)
+        return;
+    cur_size[id] = 0;
+    emit('f', id, 0);
+    if (nfree_ids == free_ids_cap) {
+        free_ids_cap = free_ids_cap ? 2 * free_ids_cap : 1 << 12;
+        free_ids = xrealloc(free_ids, free_ids_cap * sizeof(*free_ids));
+    }
+    free_ids[nfree_ids++] = id;
+}
+
+/*
+ * run_events - Carry out every pending free and realloc due by time now
+ */
+static void run_events(uint64_t now)
+{
+    event_t e;
+
+    while (nevents > 0 && events[0].time <= now) {
+        e = pop_event();
+        if (e.grow)
+            grow_block(e.id, e.grow);
+        else
+            free_block(e.id);
+    }
+}
+
+/*
+ * run_phase - Generate the requests of one phase, starting at time *now
+ *     (the number of allocations so far)
+ */
+static void run_phase(const phase_t *ph, uint64_t *now)
+{
+    int *burst = xrealloc(NULL, ph->burst * sizeof(int));
+    int *prev = xrealloc(NULL, ph->burst * sizeof(int));
+    int i, j, k, nb = 0, nprev = 0, grows;
+    double life;
+    uint64_t t;
+
+    for (i = 0; i < ph->n; i++, (*now)++) {
+        run_events(*now);
+        k = new_block(sample_size(&ph->size));
+        grows = (ph->grow_k > 0 && unif() < ph->grow_p) ? ph->grow_k : 0;
+
+        if (ph->order != O_LIFE) {
+            /* producer/consumer bursts: grow in place, free later */
+            for (j = 0; j < grows; j++)
+                grow_block(k, ph->grow_f);
+            burst[nb++] = k;
+            if (nb < ph->burst && i < ph->n - 1)
+                continue;
+            /* the burst is complete: consume the one before it */
+            for (j = 0; j < nprev; j++)
+                free_block(prev[ph->order == O_FIFO ? j : nprev - 1 - j]);
+            memcpy(prev, burst, nb * sizeof(int));
+            nprev = nb;
+            nb = 0;
+            continue;
+        }
+
+        /* spread the reallocs evenly over the block's lifetime */
+        life = sample(&ph->life);
+        for (j = 1; j <= grows; j++) {
+            t = isinf(life) ? *now + j : *now + (uint64_t)(life * j / (grows + 1));
+            push_event(t, k, ph->grow_f);
+        }
+        if (!isinf(life))
+            push_event(*now + (uint64_t)life, k, 0);
+    }
+
+    for (j = 0; j < nprev; j++)
+        free_block(prev[ph->order == O_FIFO ? j : nprev - 1 - j]);
+    if (ph->drain) {
+        for (k = 0; k < num_ids; k++)
+            free_block(k);
+        nevents = 0;
+    }
+    free(burst);
+    free(prev);
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "Usage: gentrace [-s <seed>] [-w <weight>] [-o <file.rep>] "
+            "<phase>...\n");
+    fprintf(stderr, "\t-s <n>     Random seed (default 1).\n");
+    fprintf(stderr, "\t-w <n>     Trace weight (default 1).\n");
+    fprintf(stderr, "\t-o <file>  Write the trace to <file> (default stdout).\n");
+    fprintf(stderr, "See the comment at the top of gentrace.c for phases.\n");
+}
+
+int main(int argc, char **argv)
+{
+    phase_t *phases;
+    int c, i, nphases, weight = 1;
+    uint64_t now = 0;
+    size_t n;
+    const char *out = NULL;
+    FILE *f = stdout;
+
+    rng_state = 1;
+    while ((c = getopt(argc, argv, "s:w:o:h")) != EOF) {
+        switch (c) {
+        case 's':
+            rng_state = strtoull(optarg, NULL, 0);
+            break;
+        case 'w':
+            weight = atoi(optarg);
+            break;
+        case 'o':
+            out = optarg;
+            break;
+        case 'h':
+            usage();
+            exit(0);
+        default:
+            usage();
+            exit(1);
+        }
+    }
+    if (optind == argc) {
+        usage();
+        exit(1);
+    }
+
+    nphases = argc - optind;
+    phases = xrealloc(NULL, nphases * sizeof(*phases));
+    for (i = 0; i < nphases; i++)
+        parse_phase(&phases[i], argv[optind + i]);
+
+    for (i = 0; i < nphases; i++)
+        run_phase(&phases[i], &now);
+    for (i = 0; i < num_ids; i++)
+        free_block(i);
+    if (nops > INT32_MAX)
+        app_error("trace too long", NULL);
+
+    if (out != NULL && (f = fopen(out, "w")) == NULL)
+        app_error(strerror(errno), out);
+    fprintf(f, "%d\n%d\n%zu\n0\n", weight, num_ids, nops);
+    for (n = 0; n < nops; n++) {
+        if (ops[n].type == 'f')
+            fprintf(f, "f %d\n", ops[n].id);
+        else
+            fprintf(f, "%c %d %zu\n", ops[n].type, ops[n].id, ops[n].size);
+    }
+    if (f != stdout && fclose(f) != 0)
+        app_error(strerror(errno), out);
+
+    fprintf(stderr, "%d phases, %d blocks, %zu requests\n", nphases, num_ids,
+            nops);
+    return 0;
+}
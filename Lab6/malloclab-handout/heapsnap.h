@@ -0,0 +1,37 @@
+/*
+ * heapsnap.h - heap snapshot format, written by mdriver -M and read by
+ *     heapviz.py
+ *
+ * A snapshot file holds the layout of the heap every few requests of one
+ * trace. It is a heapsnap_hdr_t followed by snapshots, each a heapsnap_t
+ * followed by len bytes that describe the blocks in address order, from
+ * the first one after the prologue to the last before the epilogue. Each
+ * block is one unsigned LEB128 varint (as in btrace.h) holding
+ *
+ *     size << 1 | alloc
+ *
+ * where size is the block size in bytes, headers included. The first
+ * block starts first_offset bytes into the heap and every other one where
+ * the one before it ends. Everything is in host byte order.
+ */
+#include <stdint.h>
+
+#define HEAPSNAP_MAGIC   0x5348444d   /* "MDHS" */
+#define HEAPSNAP_VERSION 1
+
+typedef struct {
+    uint32_t magic;         /* HEAPSNAP_MAGIC */
+    uint32_t version;       /* HEAPSNAP_VERSION */
+    uint32_t num_ops;       /* requests in the trace */
+    uint32_t interval;      /* requests between snapshots */
+    uint32_t first_offset;  /* heap offset of the first block's header */
+    uint32_t reserved;      /* zero */
+} heapsnap_hdr_t;
+
+typedef struct {
+    uint32_t opnum;         /* requests replayed before this snapshot */
+    uint32_t num_blocks;    /* blocks that follow */
+    uint64_t heap_size;     /* mem_heapsize() */
+    uint64_t payload;       /* bytes the trace has live (requested sizes) */
+    uint64_t len;           /* bytes of blocks that follow */
+} heapsnap_t;
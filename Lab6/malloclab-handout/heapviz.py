@@ -0,0 +1,219 @@
+#!/usr/bin/env python3
+#
+# heapviz.py - Render the heap snapshots that mdriver -M writes (see
+#     heapsnap.h) as an HTML timeline, or as a sequence of heap map
+#     images.
+#
+# The timeline has one row per snapshot, time running down and heap
+# addresses across, every pixel shaded by how much of its address range
+# is in allocated blocks. Hovering over a row shows the snapshot's
+# utilization and fragmentation. The image sequence (--ppm) draws each
+# snapshot as a heap map of its own, the heap wrapped into rows, so that
+# individual blocks stay visible; convert with e.g.
+#     ffmpeg -i dir/%05d.ppm heap.gif
+#
+# usage: heapviz.py [-o out.html] [-w width] [--ppm dir] file.snap
+#
+import json
+import optparse
+import os
+import struct
+import sys
+
+HEAPSNAP_MAGIC = 0x5348444d
+HEAPSNAP_VERSION = 1
+HDR = struct.Struct("=IIIIII")      # heapsnap_hdr_t
+SNAP = struct.Struct("=IIQQQ")      # heapsnap_t
+
+#
+# read_snaps - Read a snapshot file and return its header and a list of
+#     snapshots, each a dict with the heapsnap_t fields and its blocks as
+#     (offset, size, alloc) tuples
+#
+def read_snaps(path):
+    with open(path, "rb") as f:
+        data = f.read()
+    if len(data) < HDR.size:
+        sys.exit("%s: not a heap snapshot file" % path)
+    magic, version, num_ops, interval, first, _ = HDR.unpack_from(data, 0)
+    if magic != HEAPSNAP_MAGIC or version != HEAPSNAP_VERSION:
+        sys.exit("%s: not a heap snapshot file (or the wrong version)" % path)
+    hdr = {"num_ops": num_ops, "interval": interval, "first": first}
+
+    snaps = []
+    pos = HDR.size
+    while pos + SNAP.size <= len(data):
+        opnum, nblocks, heap_size, payload, length = SNAP.unpack_from(data, pos)
+        pos += SNAP.size
+        end = pos + length
+        blocks = []
+        off = first
+        while pos < end:
+            v = shift = 0
+            while True:
+                b = data[pos]
+                pos += 1
+                v |= (b & 0x7f) << shift
+                shift += 7
+                if not b & 0x80:
+                    break
+            blocks.append((off, v >> 1, v & 1))
+            off += v >> 1
+        if len(blocks) != nblocks:
+            sys.exit("%s: corrupt snapshot after %d requests" % (path, opnum))
+        snaps.append({"opnum": opnum, "heap_size": heap_size,
+                      "payload": payload, "blocks": blocks})
+    return hdr, snaps
+
+#
+# summarize - Utilization and fragmentation figures for one snapshot
+#
+def summarize(s):
+    free = [size for _, size, alloc in s["blocks"] if not alloc]
+    free_bytes = sum(free)
+    largest = max(free) if free else 0
+    return {
+        "op": s["opnum"],
+        "heap": s["heap_size"],
+        "util": s["payload"] / s["heap_size"] if s["heap_size"] else 0,
+        "blocks": len(s["blocks"]),
+        "free": len(free),
+        "free_bytes": free_bytes,
+        "largest": largest,
+        # share of the free bytes unusable for a request of all of them
+        "frag": 1 - largest / free_bytes if free_bytes else 0,
+    }
+
+#
+# shade_row - Allocated share of each of width pixels, each covering
+#     span bytes of heap, as a string of digits 0-9 ('.' past the heap end)
+#
+def shade_row(s, width, span):
+    used = [0.0] * width
+    for off, size, alloc in s["blocks"]:
+        if not alloc:
+            continue
+        lo, hi = off, off + size
+        while lo < hi:
+            px = int(lo // span)
+            if px >= width:
+                break
+            edge = min(hi, (px + 1) * span)
+            used[px] += edge - lo
+            lo = edge
+    row = []
+    for px in range(width):
+        if px * span >= s["heap_size"]:
+            row.append(".")
+        else:
+            row.append(str(min(9, int(round(9 * used[px] / span)))))
+    return "".join(row)
+
+PAGE = """<!DOCTYPE html>
+<html><head><meta charset="utf-8"><title>%(title)s</title>
+<style>
+body { font: 13px sans-serif; margin: 16px; }
+canvas { border: 1px solid #999; image-rendering: pixelated; }
+#info { height: 1.4em; margin: 6px 0; font-family: monospace; }
+</style></head><body>
+<h3>%(title)s</h3>
+<div>%(num_ops)d requests, a snapshot every %(interval)d; heap addresses
+across (%(span)s bytes per pixel), time down. Dark: allocated, light:
+free, white: past the end of the heap.</div>
+<div id="info"></div>
+<canvas id="map"></canvas>
+<script>
+var rows = %(rows)s, info = %(info)s, rh = %(rh)d;
+var c = document.getElementById("map"), g = c.getContext("2d");
+c.width = rows[0].length; c.height = rows.length * rh;
+var img = g.createImageData(c.width, c.height);
+for (var y = 0; y < c.height; y++) {
+  var row = rows[Math.floor(y / rh)];
+  for (var x = 0; x < c.width; x++) {
+    var ch = row[x], i = 4 * (y * c.width + x), v = 255;
+    if (ch != ".") v = 235 - 20 * (ch - "0");
+    img.data[i] = ch == "." ? 255 : v;
+    img.data[i + 1] = ch == "." ? 255 : v;
+    img.data[i + 2] = ch == "." ? 255 : Math.min(255, v + 20);
+    img.data[i + 3] = 255;
+  }
+}
+g.putImageData(img, 0, 0);
+c.onmousemove = function (e) {
+  var s = info[Math.min(info.length - 1, Math.floor(e.offsetY / rh))];
+  document.getElementById("info").textContent =
+    "after " + s.op + " requests: heap " + s.heap + " B, util " +
+    (100 * s.util).toFixed(1) + "%%, " + s.blocks + " blocks, " + s.free +
+    " free (" + s.free_bytes + " B, largest " + s.largest + " B), frag " +
+    (100 * s.frag).toFixed(1) + "%%";
+};
+</script></body></html>
+"""
+
+#
+# write_html - Write the timeline of snaps to out
+#
+def write_html(path, hdr, snaps, width, out):
+    top = max(s["heap_size"] for s in snaps) or 1
+    span = max(1, -(-top // width))
+    width = -(-top // span)
+    rh = max(1, min(8, 800 // len(snaps)))
+    out.write(PAGE % {
+        "title": os.path.basename(path),
+        "num_ops": hdr["num_ops"],
+        "interval": hdr["interval"],
+        "span": span,
+        "rows": json.dumps([shade_row(s, width, span) for s in snaps]),
+        "info": json.dumps([summarize(s) for s in snaps]),
+        "rh": rh,
+    })
+
+#
+# write_ppm - Write each snapshot to dir as a heap map of width pixels
+#     per row, the heap wrapped into as many rows as the largest needs
+#
+def write_ppm(snaps, width, dir):
+    top = max(s["heap_size"] for s in snaps) or 1
+    span = max(1, -(-top // (width * width // 2)))
+    height = -(-top // (span * width))
+    os.makedirs(dir, exist_ok=True)
+    for n, s in enumerate(snaps):
+        row = shade_row(s, width * height, span)
+        pix = bytearray()
+        for ch in row:
+            if ch == ".":
+                pix += b"\xff\xff\xff"
+            else:
+                v = 235 - 20 * int(ch)
+                pix += bytes((v, v, min(255, v + 20)))
+        with open(os.path.join(dir, "%05d.ppm" % n), "wb") as f:
+            f.write(b"P6\n%d %d\n255\n" % (width, height))
+            f.write(pix)
+
+def main():
+    p = optparse.OptionParser(usage="%prog [-o out.html] [-w width] "
+                              "[--ppm dir] file.snap")
+    p.add_option("-o", dest="out", help="write the HTML here (default: "
+                 "the snapshot file's name with .html)")
+    p.add_option("-w", dest="width", type="int", default=1024,
+                 help="pixels across (default 1024)")
+    p.add_option("--ppm", dest="ppm", metavar="DIR",
+                 help="write a heap map image per snapshot to DIR instead")
+    opts, args = p.parse_args()
+    if len(args) != 1:
+        p.error("need one snapshot file")
+
+    hdr, snaps = read_snaps(args[0])
+    if not snaps:
+        sys.exit("%s has no snapshots" % args[0])
+    if opts.ppm:
+        write_ppm(snaps, opts.width, opts.ppm)
+        print("Wrote %d images to %s" % (len(snaps), opts.ppm))
+        return
+    out = opts.out or os.path.splitext(args[0])[0] + ".html"
+    with open(out, "w") as f:
+        write_html(args[0], hdr, snaps, opts.width, f)
+    print("Wrote %s" % out)
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,116 @@
+/*
+ * latency.c - Log-linear latency histograms for single allocator calls
+ *
+ * The driver brackets each call with lat_now. Reading the counter takes
+ * some time itself, so lat_init measures the smallest gap between two
+ * back-to-back reads and lat_record takes it off every sample. Ticks are
+ * converted to ns only when results are reported, at the TSC rate that
+ * clock.c's init_tsc calibrated for the throughput timings.
+ */
+#include "latency.h"
+#include "clock.h"
+
+static uint64_t overhead;       /* ticks taken by an empty lat_now pair */
+static double ns_per_tick = 1;  /* lat_now reads ns off x86 */
+
+void lat_init(void)
+{
+    uint64_t t0, t1, best = UINT64_MAX;
+    int i;
+
+    for (i = 0; i < 100000; i++) {
+        t0 = lat_now();
+        t1 = lat_now();
+        if (t1 - t0 < best)
+            best = t1 - t0;
+    }
+    overhead = best;
+
+#if defined(__x86_64__) || defined(__i386__)
+    /* init_fsecs has usually calibrated the TSC already; without an
+       invariant TSC, fall back on the clock rate as fsecs.c does */
+    double rate = (tsc_mhz() > 0 || init_tsc(0)) ? tsc_mhz() : mhz(0);
+
+    if (rate > 0)
+        ns_per_tick = 1e3 / rate;
+#endif
+}
+
+/*
+ * bucket - The histogram bucket that counts value v
+ */
+static int bucket(uint64_t v)
+{
+    int e;
+
+    if (v < LAT_SUB)
+        return (int)v;
+    e = 63 - __builtin_clzll(v);        /* v is in [2^e, 2^(e+1)) */
+    return ((e - LAT_SUB_BITS + 1) << LAT_SUB_BITS) +
+        (int)((v >> (e - LAT_SUB_BITS)) & (LAT_SUB - 1));
+}
+
+/*
+ * bucket_top - The largest value counted in bucket b
+ */
+static uint64_t bucket_top(int b)
+{
+    int e;
+
+    if (b < LAT_SUB)
+        return b;
+    e = (b >> LAT_SUB_BITS) + LAT_SUB_BITS - 1;
+    return ((uint64_t)(LAT_SUB + (b & (LAT_SUB - 1)) + 1) <<
+            (e - LAT_SUB_BITS)) - 1;
+}
+
+void lat_record(lat_hist_t *h, uint64_t t0, uint64_t t1)
+{
+    uint64_t v = t1 - t0;
+
+    v = (v > overhead) ? v - overhead : 0;
+    h->count[bucket(v)]++;
+    h->n++;
+    if (v > h->max)
+        h->max = v;
+}
+
+void lat_merge(lat_hist_t *dst, const lat_hist_t *src)
+{
+    int b;
+
+    for (b = 0; b < LAT_BUCKETS; b++)
+        dst->count[b] += src->count[b];
+    dst->n += src->n;
+    if (src->max > dst->max)
+        dst->max = src->max;
+}
+
+double lat_quantile(const lat_hist_t *h, double q)
+{
+    uint64_t rank, seen = 0, top;
+    int b;
+
+    if (h->n == 0)
+        return 0;
+    rank = (uint64_t)(q * h->n);
+    if (rank >= h->n)
+        rank = h->n - 1;
+    for (b = 0; b < LAT_BUCKETS; b++) {
+        seen += h->count[b];
+        if (seen > rank)
+            break;
+    }
+    top = bucket_top(b);
+    return (top < h->max ? top : h->max) * ns_per_tick;
+}
+
+double lat_max(const lat_hist_t *h)
+{
+    return h->max * ns_per_tick;
+}
+
+double lat_overhead(void)
+{
+    return overhead * ns_per_tick;
+}
@@ -0,0 +1,74 @@
+/*
+ * latency.h - prototypes for the routines in latency.c that time single
+ *     allocator calls and keep log-linear histograms of their latencies
+ */
+#include <stdint.h>
+#include <time.h>
+
+/*
+ * A histogram covers every 64-bit tick count: values below LAT_SUB are
+ * counted exactly, and each power of two above that is split into LAT_SUB
+ * equal buckets, so a bucket is never more than 1/LAT_SUB of its value
+ * wide.
+ */
+#define LAT_SUB_BITS 4
+#define LAT_SUB      (1 << LAT_SUB_BITS)
+#define LAT_BUCKETS  ((64 - LAT_SUB_BITS + 1) << LAT_SUB_BITS)
+
+typedef struct {
+    uint32_t count[LAT_BUCKETS];
+    uint64_t n;          /* number of samples */
+    uint64_t max;        /* largest sample (ticks) */
+} lat_hist_t;
+
+/*
+ * lat_now - Read the time stamp counter (on x86) or the monotonic clock
+ *     in ns (elsewhere). The fence keeps the read from being reordered
+ *     with the call being timed.
+ */
+static inline uint64_t lat_now(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    uint32_t lo, hi;
+
+    __asm__ __volatile__("lfence\n\trdtsc" : "=a"(lo), "=d"(hi) :: "memory");
+    return ((uint64_t)hi << 32) | lo;
+#else
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+/*
+ * lat_init - Measure the cost of a pair of lat_now calls, which
+ *     lat_record subtracts from every sample, and the tick rate
+ */
+void lat_init(void);
+
+/*
+ * lat_record - Add the latency t1 - t0 of one call to h
+ */
+void lat_record(lat_hist_t *h, uint64_t t0, uint64_t t1);
+
+/*
+ * lat_merge - Add the samples of src to dst
+ */
+void lat_merge(lat_hist_t *dst, const lat_hist_t *src);
+
+/*
+ * lat_quantile - Latency in ns below which a fraction q of the samples
+ *     of h fall (the upper edge of the bucket holding that sample)
+ */
+double lat_quantile(const lat_hist_t *h, double q);
+
+/*
+ * lat_max - Largest latency in h, in ns
+ */
+double lat_max(const lat_hist_t *h);
+
+/*
+ * lat_overhead - The timer overhead subtracted from each sample, in ns
+ */
+double lat_overhead(void);
@@ -0,0 +1,182 @@
+/*
+ * mbench.c - Micro-benchmarks of mm.c, next to libc malloc, on the shared
+ *     harness in bench/
+ *
+ * Usage: mbench [harness flags] (see mbench -h)
+ *
+ * mdriver times whole traces; these time single patterns of calls, so
+ * that a change to one path of the allocator (the fast reuse of a freed
+ * block, a long free list search, in-place realloc, batches) shows up on
+ * its own. mm.c starts every sample from a new heap; libc's heap is
+ * whatever the earlier calls left.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "mm.h"
+#include "memlib.h"
+#include "bench.h"
+
+#define PAIRS   100000       /* malloc/free pairs */
+#define FILL    20000        /* blocks allocated, then freed */
+#define CHURN   50000        /* random replacements ... */
+#define LIVE    1000         /* ... among this many live blocks */
+#define GROW    1024         /* reallocs, growing a block by STEP */
+#define STEP    64
+#define BATCH   1000         /* blocks per malloc_batch */
+#define BATCHES 50
+
+/* The allocator under test */
+typedef struct {
+    void *(*malloc)(size_t size);
+    void (*free)(void *ptr);
+    void *(*realloc)(void *ptr, size_t size);
+    size_t (*malloc_batch)(size_t size, size_t n, void **ptrs);
+    void (*free_batch)(void **ptrs, size_t n);
+} alloc_t;
+
+/*
+ * libc_malloc_batch, libc_free_batch - What mm.c's batch calls do, with
+ *     one libc call per block
+ */
+static size_t libc_malloc_batch(size_t size, size_t n, void **ptrs)
+{
+    size_t i;
+
+    for (i = 0; i < n; i++)
+        if ((ptrs[i] = malloc(size)) == NULL)
+            break;
+    return i;
+}
+
+static void libc_free_batch(void **ptrs, size_t n)
+{
+    size_t i;
+
+    for (i = 0; i < n; i++)
+        free(ptrs[i]);
+}
+
+static alloc_t mm = {mm_malloc, mm_free, mm_realloc,
+                     mm_malloc_batch, mm_free_batch};
+static alloc_t libc = {malloc, free, realloc,
+                       libc_malloc_batch, libc_free_batch};
+
+static void *ptrs[FILL];
+static unsigned short slots[CHURN];  /* which live block each step replaces */
+static unsigned short sizes[CHURN];  /* and the size of its replacement */
+
+/*
+ * new_heap - Setup for the mm.c benchmarks: start from an empty heap
+ */
+static void new_heap(void *argp)
+{
+    (void)argp;
+    mem_reset_brk();
+    if (mm_init() < 0) {
+        fprintf(stderr, "mbench: mm_init failed\n");
+        exit(1);
+    }
+}
+
+/* pairs - malloc and free one 16-byte block at a time */
+static void pairs(void *argp)
+{
+    alloc_t *a = argp;
+    int i;
+
+    for (i = 0; i < PAIRS; i++)
+        a->free(a->malloc(16));
+}
+
+/* fill - malloc FILL 64-byte blocks, then free them in order */
+static void fill(void *argp)
+{
+    alloc_t *a = argp;
+    int i;
+
+    for (i = 0; i < FILL; i++)
+        ptrs[i] = a->malloc(64);
+    for (i = 0; i < FILL; i++)
+        a->free(ptrs[i]);
+}
+
+/* churn - replace random blocks among LIVE of 1 to 4096 bytes */
+static void churn(void *argp)
+{
+    alloc_t *a = argp;
+    int i;
+
+    for (i = 0; i < LIVE; i++)
+        ptrs[i] = a->malloc(sizes[i]);
+    for (i = 0; i < CHURN; i++) {
+        a->free(ptrs[slots[i]]);
+        ptrs[slots[i]] = a->malloc(sizes[i]);
+    }
+    for (i = 0; i < LIVE; i++)
+        a->free(ptrs[i]);
+}
+
+/* grow - realloc a block STEP bytes larger at a time, next to a small
+   block allocated after each step, so that it cannot always grow in place */
+static void grow(void *argp)
+{
+    alloc_t *a = argp;
+    void *p = NULL;
+    int i;
+
+    for (i = 0; i < GROW; i++) {
+        p = a->realloc(p, (i + 1) * STEP);
+        ptrs[i] = a->malloc(16);
+    }
+    a->free(p);
+    for (i = 0; i < GROW; i++)
+        a->free(ptrs[i]);
+}
+
+/* batch - BATCHES rounds of malloc_batch and free_batch of 32-byte blocks */
+static void batch(void *argp)
+{
+    alloc_t *a = argp;
+    size_t n;
+    int i;
+
+    for (i = 0; i < BATCHES; i++) {
+        n = a->malloc_batch(32, BATCH, ptrs);
+        a->free_batch(ptrs, n);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    unsigned int seed = 1;
+    int i;
+
+    if (bench_options(argc, argv, "") != argc) {
+        bench_usage(argv[0], "");
+        exit(1);
+    }
+
+    /* draw churn's steps up front, so that the RNG is not timed */
+    for (i = 0; i < CHURN; i++) {
+        seed = seed * 1103515245 + 12345;
+        slots[i] = (seed >> 8) % LIVE;
+        seed = seed * 1103515245 + 12345;
+        sizes[i] = 1 + (seed >> 8) % 4096;
+    }
+
+    mem_init();
+    bench_add("mm pairs 16B", new_heap, pairs, &mm, 2 * PAIRS);
+    bench_add("libc pairs 16B", NULL, pairs, &libc, 2 * PAIRS);
+    bench_add("mm fill-drain 64B", new_heap, fill, &mm, 2 * FILL);
+    bench_add("libc fill-drain 64B", NULL, fill, &libc, 2 * FILL);
+    bench_add("mm churn 1-4096B", new_heap, churn, &mm, 2 * (CHURN + LIVE));
+    bench_add("libc churn 1-4096B", NULL, churn, &libc, 2 * (CHURN + LIVE));
+    bench_add("mm realloc grow", new_heap, grow, &mm, 3 * GROW + 1);
+    bench_add("libc realloc grow", NULL, grow, &libc, 3 * GROW + 1);
+    bench_add("mm batch 32B", new_heap, batch, &mm, 2 * BATCH * BATCHES);
+    bench_add("libc batch 32B", NULL, batch, &libc, 2 * BATCH * BATCHES);
+    i = bench_run();
+    mem_deinit();
+    return i;
+}
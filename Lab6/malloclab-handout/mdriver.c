@@ -7,9 +7,13 @@
  * Copyright (c) 2004-2015, R. Bryant and D. O'Hallaron, All rights
  * reserved.  May not be used, modified, or copied without permission.
  */
+#define _GNU_SOURCE             /* for sched_setaffinity */
 #include <assert.h>
 #include <errno.h>
 #include <float.h>
+#include <math.h>
+#include <pthread.h>
+#include <sched.h>
 #include <setjmp.h>
 #include <signal.h>
 #include <stdarg.h>
@@ -18,11 +22,20 @@
 #include <string.h>
 #include <time.h>
 #include <unistd.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
 
 
 #include "mm.h"
 #include "memlib.h"
 #include "fsecs.h"
+#include "perfctr.h"
+#include "region.h"
+#include "btrace.h"
+#include "latency.h"
+#include "heapsnap.h"
 #include "config.h"
 
 /**********************
@@ -37,6 +50,9 @@
 /* Returns true if p is ALIGNMENT-byte aligned */
 #define IS_ALIGNED(p)  ((((unsigned long)(p)) % ALIGNMENT) == 0)
 
+/* Returns true if p is aligned to a bytes */
+#define IS_ALIGNED_TO(p, a)  ((((unsigned long)(p)) % (a)) == 0)
+
 /* weights */
 #define WNONE 0
 #define WALL 1
@@ -54,27 +70,49 @@
  * Remember that index (-1) is the null pointer.
  */
 
-/* Records the extent of each block's payload */
+/*
+ * Records the extent of each block's payload. The records form a treap
+ * (a binary search tree on lo that is also a heap on prio), so that
+ * checking a new block for overlaps takes O(log n) time.
+ */
 typedef struct range_t {
     char *lo;              /* low payload address */
     char *hi;              /* high payload address */
-    struct range_t *next;  /* next list element */
+    struct range_t *left;  /* blocks below lo */
+    struct range_t *right; /* blocks above hi */
+    unsigned prio;         /* random heap priority, keeps the tree balanced */
     int index;             /* same index as free; for debugging */
 } range_t;
 
-/* Characterizes a single trace operation (allocator request) */
+/* Request types */
+enum { ALLOC, FREE, REALLOC, MEMALIGN, BATCH_ALLOC, BATCH_FREE, NUM_TYPES };
+
+/* Their names in the latency report */
+static const char *type_names[NUM_TYPES] = {
+    "malloc", "free", "realloc", "memalign", "malloc_b", "free_b"
+};
+
+/*
+ * Characterizes a single trace operation (allocator request). Packed
+ * into 16 bytes, since big traces hold millions of them.
+ */
+#define MAX_OP_ARG ((1 << 28) - 1)
+#define MAX_THREADS 64    /* most threads -T replays a trace with */
 typedef struct {
-    enum { ALLOC, FREE, REALLOC } type; /* type of request */
-    int index;                        /* index for free() to use later */
     size_t size;                      /* byte size of alloc/realloc request */
+    int index;                        /* index for free() to use later */
+    unsigned type : 4;                /* type of request */
+    unsigned arg : 28;                /* memalign alignment, or number of
+                                         ids (index, index+1...) in a batch */
 } traceop_t;
 
 /* Holds the information for one trace file*/
 typedef struct {
     char filename[MAXLINE];
-    int ignore_ranges;   /* don't check ranges (i.e. this is too big) */
+    int ignore_ranges;   /* obsolete: ranges are now checked regardless */
     int num_ids;         /* number of alloc/realloc ids */
     int num_ops;         /* number of distinct requests */
+    int num_reqs;        /* number of allocator calls they stand for */
     int weight;          /* weight for this trace (unused) */
     traceop_t *ops;      /* array of requests */
     char **blocks;       /* array of ptrs returned by malloc/realloc... */
@@ -102,13 +140,45 @@ typedef struct {
     /* run-time stats defined for both libc and student */
     int valid;       /* was the trace processed correctly by the allocator? */
     double secs;     /* number of secs needed to run the trace */
+    double secs_spread; /* ... and half the spread of its k best runs */
 
     /* defined only for the student malloc package */
     double util;     /* space utilization for this trace (always 0 for libc) */
 
+    /* resident footprint (-F only): time-weighted payload / resident
+       bytes, and the most bytes resident at once */
+    double rss_util;
+    double rss_peak;
+
+    /* the allocator's counters at the end of the trace (-S only) */
+    mm_stats_t mm;
+
+    /* hardware event counts for one run of the trace (-1 if unavailable) */
+    double counters[PERFCTR_NUM];
+
+    /* latency of each call, by request type (-L only) */
+    lat_hist_t lat[NUM_TYPES];
+
+    /* threaded replay (-T only), by number of threads less one: wall
+       time, and Jain's fairness index of the threads' throughputs */
+    double mt_secs[MAX_THREADS];
+    double mt_fair[MAX_THREADS];
+
+    /* throughput over -n repeated timings: mean, std dev, runs */
+    double kops_mean;
+    double kops_sd;
+    int reps;
+
     /* Note: secs and util are only defined if valid is true */
 } stats_t;
 
+/* What a -j worker sends back to the driver for its trace */
+typedef struct {
+    stats_t stats;
+    int errors;      /* errors found while running the trace */
+    int pages;       /* page backing the worker's heap got */
+} result_t;
+
 /* Summarizes the key statistics for a set of traces */
 typedef struct {
     double util;  /* average utilization expressed as a percentage */
@@ -124,8 +194,14 @@ typedef struct {
  * realloc and when we free.  With DBG_EXPENSIVE, we check every block
  * every operation.
  * randint_t should be a byte, in case students return unaligned memory.
+ * Past the first RANDOM_DENSE bytes of a block only the first
+ * RANDOM_WINDOW bytes of every RANDOM_STRIDE are used, so that
+ * multi-gigabyte blocks are spot-checked instead of faulted in whole.
  *******************/
 #define RANDOM_DATA_LEN (1<<16)
+#define RANDOM_DENSE    (1<<20)
+#define RANDOM_STRIDE   (1<<24)
+#define RANDOM_WINDOW   64
 typedef unsigned char randint_t;
 static const char randint_t_name[] = "byte";
 static randint_t random_data[RANDOM_DATA_LEN];
@@ -144,6 +220,39 @@ int onetime_flag = 0;
 /* by default, no timeouts */
 static int set_timeout = 0;
 
+/* if set, count hardware events for each trace (-P) */
+static int count_events = 0;
+
+/* if set, print the allocator's own statistics for each trace (-S) */
+static int mm_stats_mode = 0;
+
+/* if nonzero, snapshot the heap every this many requests (-M) */
+static int snap_interval = 0;
+
+/* if set, also sample the heap's resident pages (-F) */
+static int footprint_mode = 0;
+
+/* if set, replay the traces through the region API instead (-R) */
+static int region_mode = 0;
+
+/* if set, time each call and report latency percentiles (-L) */
+static int latency_mode = 0;
+
+/* replay each trace with 1 up to this many threads (-T) */
+static int threads = 0;
+
+/* percentage of frees -T hands to another thread to make (-X) */
+static int handoff_pct = 0;
+
+/* number of times to time each trace, for confidence intervals (-n) */
+static int reps = 1;
+
+/* number of traces to evaluate at once, each in its own process (-j) */
+static int jobs = 1;
+
+/* page backing the mm heap got (see mem_pages) */
+static int heap_pages = MEM_PAGES_DEFAULT;
+
 /* Directory where default tracefiles are found */
 static char tracedir[MAXLINE] = TRACEDIR;
 
@@ -162,11 +271,13 @@ sum_stats_t global_mm_sum_stats;
  * Function prototypes
  *********************/
 
-/* these functions manipulate range lists */
-static int add_range(range_t **ranges, char *lo, int size,
+/* these functions manipulate the range tree */
+static int add_range(range_t **ranges, char *lo, size_t size,
                      const trace_t *trace, int opnum, int index);
 static void remove_range(range_t **ranges, char *lo);
 static void clear_ranges(range_t **ranges);
+static void check_ranges(const trace_t *trace, int opnum,
+                         const range_t *ranges);
 
 /* These functions implement the debugging code */
 static void init_random_data(void);
@@ -179,6 +290,10 @@ static trace_t *read_trace(stats_t *stats, const char *tracedir,
 static void reinit_trace(trace_t *trace);
 static void free_trace(trace_t *trace);
 
+/* Counts hardware events over one extra untimed run of a speed function */
+static void eval_events(void (*f)(void *), speed_t *speed_params,
+                        stats_t *stats);
+
 /* Routines for evaluating the correctness and speed of libc malloc */
 static int eval_libc_valid(trace_t *trace);
 static void eval_libc_speed(void *ptr);
@@ -186,11 +301,28 @@ static void eval_libc_speed(void *ptr);
 /* Routines for evaluating correctnes, space utilization, and speed
    of the student's malloc package in mm.c */
 static int eval_mm_valid(trace_t *trace, range_t **ranges);
-static double eval_mm_util(trace_t *trace, int tracenum);
+static double eval_mm_util(trace_t *trace, int tracenum, stats_t *stats);
 static void eval_mm_speed(void *ptr);
+static void eval_mm_latency(trace_t *trace, lat_hist_t *lat);
+static void eval_mm_threads(trace_t *trace, stats_t *stats);
+
+/* The same, with every allocation made from a region that is reset
+   whenever the trace has no live blocks left */
+static int eval_region_valid(trace_t *trace, range_t **ranges);
+static double eval_region_util(trace_t *trace, int tracenum);
+static void eval_region_speed(void *ptr);
 
 /* Various helper routines */
 static void printresults(int n, stats_t *stats, sum_stats_t *sumstats);
+static void eval_reps(void (*f)(void *), speed_t *speed_params,
+                      stats_t *stats);
+static void write_results(const char *file, int n, stats_t *stats,
+                          sum_stats_t *sumstats, double perfindex);
+static int compare_results(const char *file, int n, stats_t *stats);
+static void open_counters(void);
+static void printlatency(int n, stats_t *stats);
+static void printthreads(int n, stats_t *stats);
+static void printmmstats(int n, stats_t *stats);
 static void usage(void);
 static void malloc_error(const trace_t *trace, int opnum, const char *fmt, ...)
     __attribute__((format(printf, 3,4)));
@@ -208,55 +340,214 @@ static void timeout_handler(int sig __attribute__((unused))) {
     longjmp(timeout_jmpbuf, 1);
 }
 
-/* Run the tests; return the number of tests run (may be less than
-   num_tracefiles, if there's a timeout) */
-static void run_tests(int num_tracefiles, const char *tracedir,
-                      char **tracefiles, 
-                      stats_t *mm_stats, range_t *ranges, speed_t *speed_params) {
-    volatile int i;
-    volatile int timed_out = 0;
+/*
+ * run_trace - Evaluate the mm package on one trace and fill in its stats.
+ *     *timed_out is set (and stays set) once the driver has timed out.
+ */
+static void run_trace(const char *tracedir, char **tracefiles, int tracenum,
+                      stats_t *stats, range_t *ranges, speed_t *speed_params,
+                      volatile int *timed_out)
+{
+    void (*speed)(void *);
 
-    for (i=0; i < num_tracefiles; i++) {
-        /* initialize simulated memory system in memlib.c *
-         * start each trace with a clean system */
-        mem_init();
+    /* initialize simulated memory system in memlib.c *
+     * start each trace with a clean system */
+    mem_init();
+    heap_pages = mem_pages();
 
-        /* handle timeouts */
-        if(setjmp(timeout_jmpbuf) != 0) {
-            timed_out = 1;
+    /* handle timeouts */
+    if(setjmp(timeout_jmpbuf) != 0) {
+        *timed_out = 1;
+    }
+
+    trace_t *trace;
+    trace = read_trace(stats, tracedir, tracefiles[tracenum]);
+    strcpy(stats->filename, trace->filename);
+    stats->ops = trace->num_reqs;
+    if(*timed_out) {
+        stats->valid = 0;
+    } else {
+        if (verbose > 1)
+            printf("Checking mm_malloc for correctness, ");
+        stats->valid = region_mode ?
+            eval_region_valid(trace, &ranges) :
+            eval_mm_valid(trace, &ranges);
+
+        if (onetime_flag) {
+            free_trace(trace);
+            return;
         }
+    }
+    if (stats->valid) {
+        if (verbose > 1)
+            printf("efficiency, ");
+        stats->util = region_mode ?
+            eval_region_util(trace, tracenum) : eval_mm_util(trace, tracenum, stats);
+        speed_params->trace = trace;
+        speed_params->ranges = ranges;
+        if (verbose > 1)
+            printf("and performance.\n");
+        speed = region_mode ? eval_region_speed : eval_mm_speed;
+        stats->secs = fsecs(speed, speed_params);
+        stats->secs_spread = fsecs_spread();
+        eval_reps(speed, speed_params, stats);
+        eval_events(speed, speed_params, stats);
+        if (latency_mode)
+            eval_mm_latency(trace, stats->lat);
+        if (threads > 0)
+            eval_mm_threads(trace, stats);
+    }
 
-        trace_t *trace;
-        trace = read_trace(&mm_stats[i], tracedir, tracefiles[i]);
-        strcpy(mm_stats[i].filename, trace->filename);
-        mm_stats[i].ops = trace->num_ops;
-        if(timed_out) {
-            mm_stats[i].valid = 0;
-        } else {
-            if (verbose > 1)
-                printf("Checking mm_malloc for correctness, ");
-            mm_stats[i].valid = eval_mm_valid(trace, &ranges);
+    free_trace(trace);
 
-            if (onetime_flag) {
-                free_trace(trace);
-                return;
+    /* clean up memory system */
+    mem_deinit();
+}
+
+/*
+ * run_tests_parallel - Like run_tests, with up to jobs traces evaluated
+ *     at once. Each trace runs in a forked worker with its own heap,
+ *     pinned to a CPU that no other running worker uses, and sends its
+ *     stats back over a pipe. The timeout (-s) applies to each worker.
+ */
+static void run_tests_parallel(int num_tracefiles, const char *tracedir,
+                               char **tracefiles, stats_t *mm_stats,
+                               range_t *ranges, speed_t *speed_params)
+{
+    cpu_set_t allowed, mine;
+    int cpus[CPU_SETSIZE];
+    int ncpus = 0;
+    pid_t pids[jobs];         /* worker running in each slot, or 0 */
+    int fds[jobs];            /* read end of its pipe */
+    int traceno[jobs];        /* trace it is evaluating */
+    int pipefd[2];
+    int next = 0, running = 0;
+    struct pollfd pfds[jobs]; /* pipes of the running workers ... */
+    int pslot[jobs];          /* ... and their slots */
+    int i, slot, status, n;
+    size_t got;
+    ssize_t r;
+    volatile int timed_out = 0;
+    result_t res;
+    pid_t pid;
+
+    /* the workers keep their own time */
+    alarm(0);
+
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) < 0)
+        unix_error("sched_getaffinity failed in run_tests_parallel");
+    for (i = 0; i < CPU_SETSIZE; i++)
+        if (CPU_ISSET(i, &allowed))
+            cpus[ncpus++] = i;
+
+    for (slot = 0; slot < jobs; slot++)
+        pids[slot] = 0;
+
+    while (next < num_tracefiles || running > 0) {
+        /* Start a worker in every free slot */
+        for (slot = 0; slot < jobs && next < num_tracefiles; slot++) {
+            if (pids[slot] != 0)
+                continue;
+            if (pipe(pipefd) < 0)
+                unix_error("pipe failed in run_tests_parallel");
+            if ((pid = fork()) < 0)
+                unix_error("fork failed in run_tests_parallel");
+
+            if (pid == 0) {
+                close(pipefd[0]);
+                CPU_ZERO(&mine);
+                CPU_SET(cpus[slot % ncpus], &mine);
+                sched_setaffinity(0, sizeof(mine), &mine);
+                if (count_events) {
+                    perfctr_fini();
+                    perfctr_init();
+                }
+                if (set_timeout > 0)
+                    alarm(set_timeout);
+
+                memset(&res, 0, sizeof(res));
+                run_trace(tracedir, tracefiles, next, &res.stats, ranges,
+                          speed_params, &timed_out);
+                res.errors = errors;
+                res.pages = heap_pages;
+                if (write(pipefd[1], &res, sizeof(res)) != sizeof(res))
+                    _exit(1);
+                _exit(0);
             }
+
+            close(pipefd[1]);
+            pids[slot] = pid;
+            fds[slot] = pipefd[0];
+            traceno[slot] = next++;
+            running++;
         }
-        if (mm_stats[i].valid) {
-            if (verbose > 1)
-                printf("efficiency, ");
-            mm_stats[i].util = eval_mm_util(trace, i);
-            speed_params->trace = trace;
-            speed_params->ranges = ranges;
-            if (verbose > 1)
-                printf("and performance.\n");
-            mm_stats[i].secs = fsecs(eval_mm_speed, speed_params);
+
+        /* Wait for whichever worker finishes first. Its result is bigger
+           than a pipe buffer, so it is read before the worker is reaped;
+           the worker cannot exit until the result is all written. */
+        for (slot = n = 0; slot < jobs; slot++) {
+            if (pids[slot] == 0)
+                continue;
+            pfds[n].fd = fds[slot];
+            pfds[n].events = POLLIN;
+            pslot[n++] = slot;
+        }
+        while (poll(pfds, n, -1) < 0)
+            if (errno != EINTR)
+                unix_error("poll failed in run_tests_parallel");
+        for (i = 0; i < n - 1 && pfds[i].revents == 0; i++)
+            ;
+        slot = pslot[i];
+
+        for (got = 0; got < sizeof(res); got += r) {
+            r = read(fds[slot], (char *)&res + got, sizeof(res) - got);
+            if (r < 0 && errno == EINTR)
+                r = 0;
+            else if (r <= 0)
+                break;       /* the worker died before writing it all */
         }
+        if (waitpid(pids[slot], &status, 0) < 0)
+            unix_error("waitpid failed in run_tests_parallel");
+
+        i = traceno[slot];
+        if (got == sizeof(res)) {
+            mm_stats[i] = res.stats;
+            errors += res.errors;
+            heap_pages = res.pages;
+        } else {
+            /* the worker died; record the trace as invalid */
+            fprintf(stderr, "ERROR: worker for %s exited abnormally\n",
+                    tracefiles[i]);
+            strcpy(mm_stats[i].filename, tracefiles[i]);
+            mm_stats[i].valid = 0;
+            errors++;
+        }
+        close(fds[slot]);
+        pids[slot] = 0;
+        running--;
+    }
+}
+
+/*
+ * run_tests - Evaluate the mm package on every trace
+ */
+static void run_tests(int num_tracefiles, const char *tracedir,
+                      char **tracefiles, 
+                      stats_t *mm_stats, range_t *ranges, speed_t *speed_params) {
+    volatile int i;
+    volatile int timed_out = 0;
 
-        free_trace(trace);
+    if (jobs > 1 && num_tracefiles > 1 && !onetime_flag) {
+        run_tests_parallel(num_tracefiles, tracedir, tracefiles, mm_stats,
+                           ranges, speed_params);
+        return;
+    }
 
-        /* clean up memory system */
-        mem_deinit();
+    for (i=0; i < num_tracefiles; i++) {
+        run_trace(tracedir, tracefiles, i, &mm_stats[i], ranges,
+                  speed_params, &timed_out);
+        if (onetime_flag)
+            return;
     }
 }
 
@@ -276,6 +567,9 @@ int main(int argc, char **argv)
     speed_t speed_params;      /* input parameters to the xx_speed routines */
 
     int run_libc = 0;     /* If set, run libc malloc (set by -l) */
+    char *outfile = NULL; /* write the results here as JSON or CSV (-o) */
+    char *basefile = NULL;/* compare the results with this file (-C) */
+    int regressions = 0;  /* slower or less space-efficient traces (-C) */
     int autograder = 0;   /* if set then called by autograder (-A) */
 
     /* temporaries used to compute the performance index */
@@ -290,7 +584,7 @@ int main(int argc, char **argv)
     /*
      * Read and interpret the command line arguments
      */
-    while ((c = getopt(argc, argv, "d:f:c:s:t:v:hVAlD")) != EOF) {
+    while ((c = getopt(argc, argv, "d:f:c:s:t:v:H:j:n:o:C:T:X:M:hVAlDFLPRS")) != EOF) {
         switch (c) {
 
         case 'A': /* Hidden Autolab driver argument */
@@ -348,6 +642,68 @@ int main(int argc, char **argv)
             set_timeout = atoi(optarg);
             break;
 
+        case 'H': /* Back the heap with huge pages */
+            if (optarg[0] < '0' || optarg[0] > '2' || optarg[1] != '\0') {
+                usage();
+                exit(1);
+            }
+            mem_set_pages(optarg[0] - '0');
+            break;
+
+        case 'P': /* Count hardware events */
+            count_events = 1;
+            break;
+
+        case 'F': /* Resident footprint */
+            footprint_mode = 1;
+            break;
+
+        case 'M': /* Heap snapshots */
+            if ((snap_interval = atoi(optarg)) < 1)
+                app_error("-M needs a positive number of requests");
+            break;
+
+        case 'S': /* Allocator statistics */
+            mm_stats_mode = 1;
+            break;
+
+        case 'R': /* Allocate through the region API */
+            region_mode = 1;
+            break;
+
+        case 'L': /* Latency histograms */
+            latency_mode = 1;
+            break;
+
+        case 'j': /* Evaluate traces in parallel */
+            jobs = atoi(optarg);
+            break;
+
+        case 'n': /* Time each trace this many times */
+            if ((reps = atoi(optarg)) < 1)
+                app_error("-n needs a positive number of runs");
+            break;
+
+        case 'T': /* Threaded replay */
+            threads = atoi(optarg);
+            if (threads < 1 || threads > MAX_THREADS)
+                app_error("-T takes 1 to %d threads", MAX_THREADS);
+            break;
+
+        case 'X': /* Hand frees off to other threads */
+            handoff_pct = atoi(optarg);
+            if (handoff_pct < 0 || handoff_pct > 100)
+                app_error("-X takes a percentage");
+            break;
+
+        case 'o': /* Machine-readable results */
+            outfile = optarg;
+            break;
+
+        case 'C': /* Compare with a baseline written by -o */
+            basefile = optarg;
+            break;
+
         case 'h': /* Print this message */
             usage();
             exit(0);
@@ -368,9 +724,42 @@ int main(int argc, char **argv)
         init_random_data();
     }
 
+    /* At most one worker per CPU we may run on, so they do not compete */
+    if (jobs != 1) {
+        cpu_set_t allowed;
+        int ncpus = 1;
+
+        if (sched_getaffinity(0, sizeof(allowed), &allowed) == 0)
+            ncpus = CPU_COUNT(&allowed);
+        if (jobs <= 0 || jobs > ncpus)
+            jobs = ncpus;
+    }
+
     /* Initialize the timing package */
     init_fsecs();
 
+    if (latency_mode) {
+        if (region_mode)
+            app_error("-L times the mm package, so it cannot be used with -R");
+        lat_init();
+    }
+    if (snap_interval && region_mode)
+        app_error("-M walks the mm package's heap, so it cannot be used "
+                  "with -R");
+    if (mm_stats_mode && region_mode)
+        app_error("-S reports on the mm package alone, so it cannot be used "
+                  "with -R");
+    if (footprint_mode && region_mode)
+        app_error("-F samples the mm package's heap, so it cannot be used "
+                  "with -R");
+    if (threads > 0 && region_mode)
+        app_error("-T replays the trace through the mm package, so it "
+                  "cannot be used with -R");
+
+    /* Open the hardware counters, if we can */
+    if (count_events)
+        open_counters();
+
     /* Initialize the timeout */
     if (set_timeout > 0) {
         signal(SIGALRM, timeout_handler);
@@ -401,6 +790,8 @@ int main(int argc, char **argv)
                 if (verbose > 1)
                     printf("and performance.\n");
                 libc_stats[i].secs = fsecs(eval_libc_speed, &speed_params);
+                libc_stats[i].secs_spread = fsecs_spread();
+                eval_events(eval_libc_speed, &speed_params, &libc_stats[i]);
             }
             free_trace(trace);
         }
@@ -429,6 +820,8 @@ int main(int argc, char **argv)
 
 
     /* Display the mm results in a compact table */
+    if (verbose > 1 || (verbose && heap_pages != MEM_PAGES_DEFAULT))
+        printf("\nHeap backed by %s.\n", mem_pages_name(heap_pages));
     if (verbose) {
         if (onetime_flag) {
             printf("\n\ncorrectness check finished, by running tracefile \"%s\".\n", tracefiles[num_tracefiles-1]);
@@ -441,6 +834,18 @@ int main(int argc, char **argv)
             printf("\nResults for mm malloc:\n");
             printresults(num_tracefiles, mm_stats, &global_mm_sum_stats);
             printf("\n");
+            if (latency_mode) {
+                printlatency(num_tracefiles, mm_stats);
+                printf("\n");
+            }
+            if (mm_stats_mode) {
+                printmmstats(num_tracefiles, mm_stats);
+                printf("\n");
+            }
+            if (threads > 0) {
+                printthreads(num_tracefiles, mm_stats);
+                printf("\n");
+            }
         }
     }
 
@@ -551,6 +956,15 @@ int main(int argc, char **argv)
         printf("Terminated with %d errors\n", errors);
     }
 
+    /* Optionally save the results and compare them with a baseline */
+    if (!onetime_flag) {
+        if (outfile != NULL)
+            write_results(outfile, num_tracefiles, mm_stats,
+                          &global_mm_sum_stats, perfindex);
+        if (basefile != NULL)
+            regressions = compare_results(basefile, num_tracefiles, mm_stats);
+    }
+
     /* Optionally emit autoresult string */
     double raw_score = perfindex;
     if (raw_score < PERF_THRESHHOLD) {
@@ -564,27 +978,56 @@ int main(int argc, char **argv)
         printf("%s\n", autoresult);
     }
 
-    exit(0);
+    exit(regressions > 0);
 }
 
 
 /*****************************************************************
- * The following routines manipulate the range list, which keeps
+ * The following routines manipulate the range tree, which keeps
  * track of the extent of every allocated block payload. We use the
- * range list to detect any overlapping allocated blocks.
+ * range tree to detect any overlapping allocated blocks. It is a
+ * balanced search tree, so the check is cheap enough to run on every
+ * trace, however large.
  ****************************************************************/
 
+/*
+ * insert_range - Put p into the treap at *ranges: insert it as a leaf,
+ *     then rotate it up past any parents with a lower priority
+ */
+static void insert_range(range_t **ranges, range_t *p)
+{
+    range_t *r = *ranges;
+
+    if (r == NULL) {
+        *ranges = p;
+    } else if (p->lo < r->lo) {
+        insert_range(&r->left, p);
+        if (r->left->prio > r->prio) {
+            *ranges = r->left;
+            r->left = (*ranges)->right;
+            (*ranges)->right = r;
+        }
+    } else {
+        insert_range(&r->right, p);
+        if (r->right->prio > r->prio) {
+            *ranges = r->right;
+            r->right = (*ranges)->left;
+            (*ranges)->left = r;
+        }
+    }
+}
+
 /*
  * add_range - As directed by request opnum in trace tracenum,
  *     we've just called the student's mm_malloc to allocate a block of
  *     size bytes at addr lo. After checking the block for correctness,
- *     we create a range struct for this block and add it to the range list.
+ *     we create a range struct for this block and add it to the range tree.
  */
-static int add_range(range_t **ranges, char *lo, int size,
+static int add_range(range_t **ranges, char *lo, size_t size,
                      const trace_t *trace, int opnum, int index)
 {
     char *hi = lo + size - 1;
-    range_t *p;
+    range_t *p, *r;
 
     assert(size > 0);
 
@@ -604,33 +1047,38 @@ static int add_range(range_t **ranges, char *lo, int size,
         return 0;
     }
 
-    /* If we can't afford the linear-time loop, we check less thoroughly and
-       just assume the overlap will be caught by writing random bits. */
-    if(trace->ignore_ranges || debug_mode == DBG_NONE) return 1;
-
-
-    /* The payload must not overlap any other payloads */
-    for (p = *ranges;  p != NULL;  p = p->next) {
-        if ((lo >= p->lo && lo <= p-> hi) ||
-            (hi >= p->lo && hi <= p->hi)) {
-            malloc_error(trace, opnum,
-                         "Payload (%p:%p) overlaps another payload (%p:%p)\n",
-                         lo, hi, p->lo, p->hi);
-            return 0;
+    /*
+     * The payload must not overlap any other payloads. The ranges are
+     * disjoint, so only the one with the highest lo at or below our hi
+     * can reach up into our payload.
+     */
+    for (r = *ranges, p = NULL;  r != NULL; ) {
+        if (r->lo <= hi) {
+            p = r;
+            r = r->right;
+        } else {
+            r = r->left;
         }
     }
+    if (p != NULL && p->hi >= lo) {
+        malloc_error(trace, opnum,
+                     "Payload (%p:%p) overlaps another payload (%p:%p)\n",
+                     lo, hi, p->lo, p->hi);
+        return 0;
+    }
 
     /*
      * Everything looks OK, so remember the extent of this block
-     * by creating a range struct and adding it the range list.
+     * by creating a range struct and adding it the range tree.
      */
     if ((p = (range_t *)malloc(sizeof(range_t))) == NULL)
         unix_error("malloc error in add_range");
-    p->next = *ranges;
     p->lo = lo;
     p->hi = hi;
     p->index = index;
-    *ranges = p;
+    p->left = p->right = NULL;
+    p->prio = random();
+    insert_range(ranges, p);
 
     return 1;
 }
@@ -640,16 +1088,43 @@ static int add_range(range_t **ranges, char *lo, int size,
  */
 static void remove_range(range_t **ranges, char *lo)
 {
+    range_t **pp = ranges;
     range_t *p;
-    range_t **prevpp = ranges;
 
-    for (p = *ranges;  p != NULL; p = p->next) {
-        if (p->lo == lo) {
-            *prevpp = p->next;
-            free(p);
-            break;
+    /* find it... */
+    while (*pp != NULL && (*pp)->lo != lo)
+        pp = (lo < (*pp)->lo) ? &(*pp)->left : &(*pp)->right;
+    if ((p = *pp) == NULL)
+        return;
+
+    /* ...and rotate it down until it has at most one child */
+    while (p->left != NULL && p->right != NULL) {
+        if (p->left->prio > p->right->prio) {
+            *pp = p->left;
+            p->left = (*pp)->right;
+            (*pp)->right = p;
+            pp = &(*pp)->right;
+        } else {
+            *pp = p->right;
+            p->right = (*pp)->left;
+            (*pp)->left = p;
+            pp = &(*pp)->left;
         }
-        prevpp = &(p->next);
+    }
+    *pp = (p->left != NULL) ? p->left : p->right;
+    free(p);
+}
+
+/*
+ * check_ranges - check the data of every block in the range tree
+ */
+static void check_ranges(const trace_t *trace, int opnum,
+                         const range_t *ranges)
+{
+    while (ranges != NULL) {
+        check_ranges(trace, opnum, ranges->left);
+        check_index(trace, opnum, ranges->index);
+        ranges = ranges->right;
     }
 }
 
@@ -659,12 +1134,12 @@ static void remove_range(range_t **ranges, char *lo)
 static void clear_ranges(range_t **ranges)
 {
     range_t *p;
-    range_t *pnext;
 
-    for (p = *ranges;  p != NULL;  p = pnext) {
-        pnext = p->next;
-        free(p);
-    }
+    if ((p = *ranges) == NULL)
+        return;
+    clear_ranges(&p->left);
+    clear_ranges(&p->right);
+    free(p);
     *ranges = NULL;
 }
 
@@ -673,6 +1148,17 @@ static void clear_ranges(range_t **ranges)
  * checking memory access.
  *********************************************/
 
+/*
+ * next_random_byte - the offset of the next byte after i that the random
+ *     data checks use (see RANDOM_DENSE)
+ */
+static size_t next_random_byte(size_t i) {
+    i++;
+    if(i >= RANDOM_DENSE && i % RANDOM_STRIDE >= RANDOM_WINDOW)
+        i += RANDOM_STRIDE - i % RANDOM_STRIDE;
+    return i;
+}
+
 static void init_random_data(void) {
     int len;
 
@@ -697,7 +1183,7 @@ static void randomize_block(trace_t *traces, int index) {
     size = traces->block_sizes[index] / sizeof(*block);
     base = traces->block_rand_base[index];
 
-    for(i = 0; i < size; i++) {
+    for(i = 0; i < size; i = next_random_byte(i)) {
         block[i] = random_data[(base + i) % RANDOM_DATA_LEN];
     }
 }
@@ -708,7 +1194,7 @@ static void check_index(const trace_t *trace, int opnum, int index) {
     randint_t *block;
     int base;
     int ngarbled = 0;
-    int firstgarbled = -1;
+    long firstgarbled = -1;
 
     if(index < 0) return; /* we're doing free(NULL) */
     if(debug_mode == DBG_NONE) return;
@@ -717,7 +1203,7 @@ static void check_index(const trace_t *trace, int opnum, int index) {
     size = trace->block_sizes[index] / sizeof(*block);
     base = trace->block_rand_base[index];
 
-    for(i = 0; i < size; i++) {
+    for(i = 0; i < size; i = next_random_byte(i)) {
         if(block[i] != random_data[(base + i) % RANDOM_DATA_LEN]) {
             if(firstgarbled == -1) firstgarbled = i;
             ngarbled++;
@@ -735,42 +1221,19 @@ static void check_index(const trace_t *trace, int opnum, int index) {
  *********************************************/
 
 /*
- * read_trace - read a trace file and store it in memory
+ * alloc_trace - allocate the arrays of a trace whose header has been read
  */
-static trace_t *read_trace(stats_t *stats, const char *tracedir,
-                           const char *filename)
+static void alloc_trace(trace_t *trace)
 {
-    FILE *tracefile;
-    trace_t *trace;
-    char type[MAXLINE];
-    int index, size;
-    int max_index = 0;
-    int op_index;
-
-    if (verbose > 1)
-        printf("Reading tracefile: %s\n", filename);
-
-    /* Allocate the trace record */
-    if ((trace = (trace_t *) malloc(sizeof(trace_t))) == NULL)
-        unix_error("malloc 1 failed in read_trace");
-
-    /* Read the trace file header */
-    strcpy(trace->filename, tracedir);
-    strcat(trace->filename, filename);
-    if ((tracefile = fopen(trace->filename, "r")) == NULL) {
-        unix_error("Could not open %s in read_trace", trace->filename);
-    }
-    fscanf(tracefile, "%d", &trace->weight);
-    fscanf(tracefile, "%d", &trace->num_ids);
-    fscanf(tracefile, "%d", &trace->num_ops);
-    fscanf(tracefile, "%d", &trace->ignore_ranges);
-
     if(trace->weight < 0 || trace->weight > 3) {
         app_error("%s: weight can only be in {0, 1, 2 3}", trace->filename);
     }
     if(trace->ignore_ranges != 0 && trace->ignore_ranges != 1) {
         app_error("%s: ignore-ranges can only be zero or one", trace->filename);
     }
+    if(trace->num_ids < 0 || trace->num_ops < 0) {
+        app_error("%s: bad trace header", trace->filename);
+    }
 
     /* We'll store each request line in the trace in this array */
     if ((trace->ops =
@@ -791,47 +1254,264 @@ static trace_t *read_trace(stats_t *stats, const char *tracedir,
     if ((trace->block_rand_base =
          calloc(trace->num_ids, sizeof(*trace->block_rand_base))) == NULL)
         unix_error("malloc 5 failed in read_trace");
+}
+
+/*
+ * check_arg - make sure a memalign alignment or batch count fits in
+ *     traceop_t
+ */
+static void check_arg(const trace_t *trace, size_t arg)
+{
+    if (arg > MAX_OP_ARG)
+        app_error("%s: argument %zu too large (max %d)\n",
+                  trace->filename, arg, MAX_OP_ARG);
+}
+
+/*
+ * read_text_trace - parse the header and requests of a .rep file
+ */
+static void read_text_trace(trace_t *trace, FILE *tracefile)
+{
+    char type[MAXLINE];
+    int index;
+    size_t size, align, count;
+    int max_index = 0;
+    int op_index;
 
+    fscanf(tracefile, "%d", &trace->weight);
+    fscanf(tracefile, "%d", &trace->num_ids);
+    fscanf(tracefile, "%d", &trace->num_ops);
+    fscanf(tracefile, "%d", &trace->ignore_ranges);
+    alloc_trace(trace);
 
     /* read every request line in the trace file */
     index = 0;
     op_index = 0;
+    trace->num_reqs = 0;
     while (fscanf(tracefile, "%s", type) != EOF) {
         switch(type[0]) {
         case 'a':
-            fscanf(tracefile, "%u %u", &index, &size);
+            fscanf(tracefile, "%u %zu", &index, &size);
             trace->ops[op_index].type = ALLOC;
             trace->ops[op_index].index = index;
             trace->ops[op_index].size = size;
             max_index = (index > max_index) ? index : max_index;
             break;
         case 'r':
-            fscanf(tracefile, "%u %u", &index, &size);
+            fscanf(tracefile, "%u %zu", &index, &size);
             trace->ops[op_index].type = REALLOC;
             trace->ops[op_index].index = index;
             trace->ops[op_index].size = size;
             max_index = (index > max_index) ? index : max_index;
             break;
+        case 'm':
+            fscanf(tracefile, "%u %zu %zu", &index, &align, &size);
+            if (align == 0 || (align & (align - 1)))
+                app_error("%s: memalign alignment %zu is not a power of 2\n",
+                          trace->filename, align);
+            check_arg(trace, align);
+            trace->ops[op_index].type = MEMALIGN;
+            trace->ops[op_index].index = index;
+            trace->ops[op_index].size = size;
+            trace->ops[op_index].arg = align;
+            max_index = (index > max_index) ? index : max_index;
+            break;
         case 'f':
             fscanf(tracefile, "%ud", &index);
             trace->ops[op_index].type = FREE;
             trace->ops[op_index].index = index;
             break;
+        case 'b':
+            fscanf(tracefile, "%u %zu %zu", &index, &count, &size);
+            check_arg(trace, count);
+            if (count == 0)
+                app_error("%s: block id out of range in request %d\n",
+                          trace->filename, op_index);
+            trace->ops[op_index].type = BATCH_ALLOC;
+            trace->ops[op_index].index = index;
+            trace->ops[op_index].size = size;
+            trace->ops[op_index].arg = count;
+            max_index = (index + (int)count - 1 > max_index) ?
+                index + (int)count - 1 : max_index;
+            trace->num_reqs += count - 1;
+            break;
+        case 'B':
+            fscanf(tracefile, "%u %zu", &index, &count);
+            check_arg(trace, count);
+            if (count == 0)
+                app_error("%s: block id out of range in request %d\n",
+                          trace->filename, op_index);
+            trace->ops[op_index].type = BATCH_FREE;
+            trace->ops[op_index].index = index;
+            trace->ops[op_index].arg = count;
+            trace->num_reqs += count - 1;
+            break;
         default:
             app_error("Bogus type character (%c) in tracefile %s\n",
                       type[0], trace->filename);
         }
         op_index++;
+        trace->num_reqs++;
         if(op_index == trace->num_ops) break;
     }
-    fclose(tracefile);
     assert(max_index == trace->num_ids - 1);
     assert(trace->num_ops == op_index);
+}
+
+/*
+ * get_varint - decode the varint at *pp, failing if it runs past end
+ */
+static uint64_t get_varint(const trace_t *trace, const unsigned char **pp,
+                           const unsigned char *end)
+{
+    const unsigned char *p = *pp;
+    uint64_t v = 0;
+    int shift = 0;
+
+    do {
+        if (p == end || shift > 63)
+            app_error("%s: truncated or corrupt binary trace",
+                      trace->filename);
+        v |= (uint64_t)(*p & 0x7f) << shift;
+        shift += 7;
+    } while (*p++ & 0x80);
+    *pp = p;
+    return v;
+}
+
+/*
+ * read_bin_trace - decode a binary trace (see btrace.h) that has been
+ *     mapped into memory at p, len bytes in all
+ */
+static void read_bin_trace(trace_t *trace, const unsigned char *p,
+                           size_t len)
+{
+    static const int types[] = {
+        [BTRACE_ALLOC] = ALLOC, [BTRACE_REALLOC] = REALLOC,
+        [BTRACE_FREE] = FREE, [BTRACE_MEMALIGN] = MEMALIGN,
+        [BTRACE_BATCH_ALLOC] = BATCH_ALLOC, [BTRACE_BATCH_FREE] = BATCH_FREE
+    };
+    const btrace_hdr_t *hdr = (const btrace_hdr_t *)p;
+    const unsigned char *end;
+    traceop_t *op;
+    int64_t index = 0;
+    uint64_t n;
+    int i, code;
+
+    if (len < sizeof(*hdr) || hdr->version != BTRACE_VERSION ||
+        hdr->data_len > len - sizeof(*hdr))
+        app_error("%s: unsupported or truncated binary trace",
+                  trace->filename);
+    trace->weight = hdr->weight;
+    trace->num_ids = hdr->num_ids;
+    trace->num_ops = hdr->num_ops;
+    trace->ignore_ranges = hdr->ignore_ranges;
+    trace->num_reqs = hdr->num_reqs;
+    alloc_trace(trace);
+
+    p += sizeof(*hdr);
+    end = p + hdr->data_len;
+    for (i = 0, op = trace->ops; i < trace->num_ops; i++, op++) {
+        if (p == end || (code = *p++) < BTRACE_ALLOC ||
+            code > BTRACE_BATCH_FREE)
+            app_error("%s: truncated or corrupt binary trace",
+                      trace->filename);
+        op->type = types[code];
+        n = get_varint(trace, &p, end);
+        index += UNZIGZAG(n);
+        n = 1;
+        switch (code) {
+        case BTRACE_ALLOC:
+        case BTRACE_REALLOC:
+            op->size = get_varint(trace, &p, end);
+            break;
+        case BTRACE_MEMALIGN:
+            n = get_varint(trace, &p, end);
+            if (n == 0 || (n & (n - 1)))
+                app_error("%s: memalign alignment %zu is not a power of 2\n",
+                          trace->filename, (size_t)n);
+            check_arg(trace, n);
+            op->arg = n;
+            op->size = get_varint(trace, &p, end);
+            n = 1;
+            break;
+        case BTRACE_BATCH_ALLOC:
+            n = get_varint(trace, &p, end);
+            op->size = get_varint(trace, &p, end);
+            break;
+        case BTRACE_BATCH_FREE:
+            n = get_varint(trace, &p, end);
+            break;
+        }
+        if (code == BTRACE_BATCH_ALLOC || code == BTRACE_BATCH_FREE) {
+            check_arg(trace, n);
+            op->arg = n;
+        }
+        /* index -1 is the null pointer, which may be freed */
+        if (index < (code == BTRACE_FREE ? -1 : 0) || n == 0 ||
+            index + (int64_t)n > trace->num_ids)
+            app_error("%s: block id out of range in request %d",
+                      trace->filename, i);
+        op->index = index;
+    }
+}
+
+/*
+ * read_trace - read a trace file and store it in memory. Both the text
+ *     (.rep) format and the binary format of rep2bin are accepted; binary
+ *     traces are mapped and decoded in place, which is much faster.
+ */
+static trace_t *read_trace(stats_t *stats, const char *tracedir,
+                           const char *filename)
+{
+    FILE *tracefile;
+    trace_t *trace;
+    uint32_t magic = 0;
+    struct stat st;
+    struct timespec start, end;
+    void *map;
+
+    if (verbose > 1)
+        printf("Reading tracefile: %s\n", filename);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    /* Allocate the trace record */
+    if ((trace = (trace_t *) malloc(sizeof(trace_t))) == NULL)
+        unix_error("malloc 1 failed in read_trace");
+
+    /* Read the trace file header */
+    strcpy(trace->filename, tracedir);
+    strcat(trace->filename, filename);
+    if ((tracefile = fopen(trace->filename, "r")) == NULL) {
+        unix_error("Could not open %s in read_trace", trace->filename);
+    }
+    if (fread(&magic, sizeof(magic), 1, tracefile) == 1 &&
+        magic == BTRACE_MAGIC) {
+        if (fstat(fileno(tracefile), &st) < 0)
+            unix_error("Could not stat %s in read_trace", trace->filename);
+        map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE,
+                   fileno(tracefile), 0);
+        if (map == MAP_FAILED)
+            unix_error("Could not map %s in read_trace", trace->filename);
+        madvise(map, st.st_size, MADV_SEQUENTIAL);
+        read_bin_trace(trace, map, st.st_size);
+        munmap(map, st.st_size);
+    } else {
+        rewind(tracefile);
+        read_text_trace(trace, tracefile);
+    }
+    fclose(tracefile);
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    if (verbose > 1)
+        printf("Read %d requests in %.3f secs\n", trace->num_ops,
+               (end.tv_sec - start.tv_sec) +
+               (end.tv_nsec - start.tv_nsec) / 1e9);
 
     /* fill in the stats */
     strcpy(stats->filename, trace->filename);
     stats->weight = trace->weight;
-    stats->ops = trace->num_ops;
+    stats->ops = trace->num_reqs;
 
     return trace;
 }
@@ -872,11 +1552,12 @@ static int eval_mm_valid(trace_t *trace, range_t **ranges)
     int i;
     int index;
     size_t size;
+    size_t k, n;
     char *newp;
     char *oldp;
     char *p;
 
-    /* Reset the heap and free any records in the range list */
+    /* Reset the heap and free any records in the range tree */
     mem_reset_brk();
     clear_ranges(ranges);
     reinit_trace(trace);
@@ -893,32 +1574,40 @@ static int eval_mm_valid(trace_t *trace, range_t **ranges)
         size = trace->ops[i].size;
 
         if(debug_mode == DBG_EXPENSIVE) {
-            range_t *r;
-                        
             /* Let the students check their own heap */
             mm_checkheap(verbose);
 
             /* Now check that all our allocated blocks have the right data */
-            r = *ranges;
-            while(r) {
-                check_index(trace, i, r->index);
-                r = r->next;
-            }
+            check_ranges(trace, i, *ranges);
         }
 
         switch (trace->ops[i].type) {
 
         case ALLOC: /* mm_malloc */
+        case MEMALIGN: /* mm_memalign */
 
             /* Call the student's malloc */
-            if ((p = mm_malloc(size)) == NULL) {
-                malloc_error(trace, i, "mm_malloc failed.");
-                return 0;
-            }
-
-            /*
-             * Test the range of the new block for correctness and add it
-             * to the range list if OK. The block must be  be aligned properly,
+            if (trace->ops[i].type == ALLOC) {
+                if ((p = mm_malloc(size)) == NULL) {
+                    malloc_error(trace, i, "mm_malloc failed.");
+                    return 0;
+                }
+            } else {
+                if ((p = mm_memalign(trace->ops[i].arg, size)) == NULL) {
+                    malloc_error(trace, i, "mm_memalign failed.");
+                    return 0;
+                }
+                if (!IS_ALIGNED_TO(p, trace->ops[i].arg)) {
+                    malloc_error(trace, i,
+                                 "Payload address (%p) not aligned to %u bytes",
+                                 p, (unsigned)trace->ops[i].arg);
+                    return 0;
+                }
+            }
+
+            /*
+             * Test the range of the new block for correctness and add it
+             * to the range tree if OK. The block must be  be aligned properly,
              * and must not overlap any currently allocated block.
              */
             if (add_range(ranges, p, size, trace, i, index) == 0)
@@ -949,10 +1638,10 @@ static int eval_mm_valid(trace_t *trace, range_t **ranges)
             }
 
 
-            /* Remove the old region from the range list */
+            /* Remove the old region from the range tree */
             remove_range(ranges, oldp);
 
-            /* Check new block for correctness and add it to range list */
+            /* Check new block for correctness and add it to range tree */
             if (size > 0) {
                 if(add_range(ranges, newp, size, trace, i, index) == 0)
                     return 0;
@@ -985,6 +1674,34 @@ static int eval_mm_valid(trace_t *trace, range_t **ranges)
             mm_free(p);
             break;
 
+        case BATCH_ALLOC: /* mm_malloc_batch */
+            n = trace->ops[i].arg;
+            if (mm_malloc_batch(size, n, (void **)&trace->blocks[index]) != n) {
+                malloc_error(trace, i, "mm_malloc_batch failed.");
+                return 0;
+            }
+
+            /* Check and remember each block as if it came from malloc */
+            for (k = 0; k < n; k++) {
+                if (add_range(ranges, trace->blocks[index + k], size,
+                              trace, i, index + k) == 0)
+                    return 0;
+                trace->block_sizes[index + k] = size;
+                randomize_block(trace, index + k);
+            }
+            break;
+
+        case BATCH_FREE: /* mm_free_batch */
+            n = trace->ops[i].arg;
+            for (k = 0; k < n; k++) {
+                check_index(trace, i, index + k);
+                remove_range(ranges, trace->blocks[index + k]);
+            }
+
+            /* Note: this leaves the (dead) blocks array entries reordered */
+            mm_free_batch((void **)&trace->blocks[index], n);
+            break;
+
         default:
             app_error("Nonexistent request type in eval_mm_valid");
         }
@@ -995,6 +1712,160 @@ static int eval_mm_valid(trace_t *trace, range_t **ranges)
     return 1;
 }
 
+/*
+ * Resident footprint samples, taken by eval_mm_util with -F. Each sample
+ * weighs the live payload and the resident bytes by the number of
+ * requests since the previous one, so their ratio is a time-weighted
+ * utilization with requests as the clock.
+ */
+#define FOOT_SAMPLES    1000  /* samples at intervals over a trace */
+#define FOOT_PEAK_GRAIN 64    /* and at each 1/64 rise of the payload peak */
+typedef struct {
+    int last_op;        /* requests done at the previous sample */
+    size_t last_peak;   /* payload at the last sample taken for a peak */
+    double payload;     /* sum of payload bytes * requests */
+    double resident;    /* sum of resident bytes * requests */
+    double peak;        /* most bytes resident in any sample */
+} foot_t;
+
+/*
+ * Heap snapshots, taken by eval_mm_util with -M (the format is in
+ * heapsnap.h). Each trace gets its own file, named after the trace with
+ * .snap for .rep, in the current directory.
+ */
+typedef struct {
+    FILE *f;
+    char name[MAXLINE];
+    unsigned char *buf;   /* the blocks of the snapshot being taken */
+    size_t len;
+    size_t cap;
+    uint32_t blocks;
+    char *first;          /* payload of the first block */
+    int count;            /* snapshots written */
+} snap_t;
+
+/*
+ * snap_block - mm_walk callback that appends a block to the snapshot
+ */
+static void snap_block(void *bp, size_t size, int alloc, void *arg)
+{
+    snap_t *snap = arg;
+    uint64_t v = (uint64_t)size << 1 | (alloc != 0);
+
+    if (snap->len + 10 > snap->cap) {
+        snap->cap = snap->cap ? 2 * snap->cap : 4096;
+        if ((snap->buf = realloc(snap->buf, snap->cap)) == NULL)
+            unix_error("realloc failed in snap_block");
+    }
+    if (snap->blocks++ == 0)
+        snap->first = bp;
+    while (v >= 0x80) {
+        snap->buf[snap->len++] = (unsigned char)(v & 0x7f) | 0x80;
+        v >>= 7;
+    }
+    snap->buf[snap->len++] = (unsigned char)v;
+}
+
+/*
+ * snap_take - Walk the heap and write a snapshot of it after opnum
+ *     requests, with payload bytes live
+ */
+static void snap_take(snap_t *snap, int opnum, size_t payload)
+{
+    heapsnap_t s;
+
+    snap->len = 0;
+    snap->blocks = 0;
+    mm_walk(snap_block, snap);
+
+    s.opnum = opnum;
+    s.num_blocks = snap->blocks;
+    s.heap_size = mem_heapsize();
+    s.payload = payload;
+    s.len = snap->len;
+    if (fwrite(&s, sizeof(s), 1, snap->f) != 1 ||
+        fwrite(snap->buf, 1, snap->len, snap->f) != snap->len)
+        unix_error("Could not write heap snapshot to %s", snap->name);
+    snap->count++;
+}
+
+/*
+ * snap_open - Create the snapshot file for trace and write its header
+ *     and a snapshot of the heap as mm_init left it
+ */
+static void snap_open(snap_t *snap, const trace_t *trace)
+{
+    heapsnap_hdr_t hdr;
+    const char *base = strrchr(trace->filename, '/');
+    char *ext;
+
+    memset(snap, 0, sizeof(*snap));
+    snprintf(snap->name, sizeof(snap->name), "%.*s",
+             (int)sizeof(snap->name) - 6, base ? base + 1 : trace->filename);
+    if ((ext = strrchr(snap->name, '.')) != NULL)
+        *ext = '\0';
+    strcat(snap->name, ".snap");
+    if ((snap->f = fopen(snap->name, "wb")) == NULL)
+        unix_error("Could not open %s for heap snapshots", snap->name);
+
+    /* the first walk tells us where the blocks start */
+    mm_walk(snap_block, snap);
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.magic = HEAPSNAP_MAGIC;
+    hdr.version = HEAPSNAP_VERSION;
+    hdr.num_ops = trace->num_ops;
+    hdr.interval = snap_interval;
+    hdr.first_offset = snap->first ? snap->first - (char *)mem_heap_lo() : 0;
+    if (fwrite(&hdr, sizeof(hdr), 1, snap->f) != 1)
+        unix_error("Could not write heap snapshot to %s", snap->name);
+    snap_take(snap, 0, 0);
+}
+
+/*
+ * snap_close - Close the snapshot file
+ */
+static void snap_close(snap_t *snap)
+{
+    if (fclose(snap->f) != 0)
+        unix_error("Could not write heap snapshot to %s", snap->name);
+    if (verbose > 1)
+        printf("(%d heap snapshots in %s) ", snap->count, snap->name);
+    free(snap->buf);
+}
+
+/*
+ * touch_payload - Write a byte to each page of a new block, as the
+ *     program that made the request would, so that the pages the payload
+ *     spans count as resident
+ */
+static void touch_payload(char *p, size_t size)
+{
+    size_t off, page = mem_pagesize();
+
+    for (off = 0; off < size; off += page)
+        p[off] = 0;
+    if (size > 0)
+        p[size - 1] = 0;
+}
+
+/*
+ * sample_footprint - Take a resident footprint sample after opnum
+ *     requests, with payload bytes live
+ */
+static void sample_footprint(foot_t *foot, int opnum, size_t payload)
+{
+    double resident = mem_resident();
+    int weight = opnum - foot->last_op;
+
+    foot->payload += (double)payload * weight;
+    foot->resident += resident * weight;
+    if (resident > foot->peak)
+        foot->peak = resident;
+    if (payload > foot->last_peak)
+        foot->last_peak = payload;
+    foot->last_op = opnum;
+}
+
 /*
  * eval_mm_util - Evaluate the space utilization of the student's package
  *   The idea is to remember the high water mark "hwm" of the heap for
@@ -1006,32 +1877,51 @@ static int eval_mm_valid(trace_t *trace, range_t **ranges)
  *   is always the high water mark of the heap.
  *
  *   A higher number is better: 1 is optimal.
+ *
+ *   With -F, the heap's resident pages are also sampled with mincore
+ *   (see sample_footprint), which credits pages the allocator never
+ *   touched or handed back to the kernel.
  */
-static double eval_mm_util(trace_t *trace, int tracenum)
+static double eval_mm_util(trace_t *trace, int tracenum, stats_t *stats)
 {
     int i;
+    double util;
+    foot_t foot = { 0, 0, 0, 0, 0 };
+    snap_t snap;
+    int step = trace->num_ops / FOOT_SAMPLES + 1;
     int index;
-    int size, newsize, oldsize;
-    int max_total_size = 0;
-    int total_size = 0;
+    size_t size, newsize, oldsize;
+    size_t k, n;
+    size_t max_total_size = 0;
+    size_t total_size = 0;
     char *p;
     char *newp, *oldp;
 
     reinit_trace(trace);
 
     /* initialize the heap and the mm malloc package */
-    mem_reset_brk();
+    if (footprint_mode)
+        mem_discard();
+    else
+        mem_reset_brk();
     if (mm_init() < 0)
         app_error("trace %d: mm_init failed in eval_mm_util", tracenum);
+    if (snap_interval)
+        snap_open(&snap, trace);
 
     for (i = 0;  i < trace->num_ops;  i++) {
         switch (trace->ops[i].type) {
 
         case ALLOC: /* mm_alloc */
+        case MEMALIGN: /* mm_memalign */
             index = trace->ops[i].index;
             size = trace->ops[i].size;
 
-            if ((p = mm_malloc(size)) == NULL) {
+            if (trace->ops[i].type == ALLOC)
+                p = mm_malloc(size);
+            else
+                p = mm_memalign(trace->ops[i].arg, size);
+            if (p == NULL) {
                 app_error("trace %d: mm_malloc failed in eval_mm_util",
                           tracenum);
             }
@@ -1039,6 +1929,8 @@ static double eval_mm_util(trace_t *trace, int tracenum)
             /* Remember region and size */
             trace->blocks[index] = p;
             trace->block_sizes[index] = size;
+            if (footprint_mode)
+                touch_payload(p, size);
 
             total_size += size;
             break;
@@ -1054,94 +1946,841 @@ static double eval_mm_util(trace_t *trace, int tracenum)
                           tracenum);
             }
 
-            /* Remember region and size */
-            trace->blocks[index] = newp;
-            trace->block_sizes[index] = newsize;
+            /* Remember region and size */
+            trace->blocks[index] = newp;
+            trace->block_sizes[index] = newsize;
+            if (footprint_mode)
+                touch_payload(newp, newsize);
+
+            total_size += (newsize - oldsize);
+            break;
+
+        case FREE: /* mm_free */
+            index = trace->ops[i].index;
+            if(index < 0) {
+                size = 0;
+                p = 0;
+            } else {
+                size = trace->block_sizes[index];
+                p = trace->blocks[index];
+            }
+
+            mm_free(p);
+
+            total_size -= size;
+            break;
+
+        case BATCH_ALLOC: /* mm_malloc_batch */
+            index = trace->ops[i].index;
+            size = trace->ops[i].size;
+            n = trace->ops[i].arg;
+            if (mm_malloc_batch(size, n, (void **)&trace->blocks[index]) != n) {
+                app_error("trace %d: mm_malloc_batch failed in eval_mm_util",
+                          tracenum);
+            }
+            for (k = 0; k < n; k++) {
+                trace->block_sizes[index + k] = size;
+                if (footprint_mode)
+                    touch_payload(trace->blocks[index + k], size);
+            }
+
+            total_size += n * size;
+            break;
+
+        case BATCH_FREE: /* mm_free_batch */
+            index = trace->ops[i].index;
+            n = trace->ops[i].arg;
+            for (k = 0; k < n; k++)
+                total_size -= trace->block_sizes[index + k];
+
+            mm_free_batch((void **)&trace->blocks[index], n);
+            break;
+
+        default:
+            app_error("trace %d: Nonexistent request type in eval_mm_util",
+                      tracenum);
+        }
+
+        /* update the high-water mark */
+        max_total_size = (total_size > max_total_size) ?
+            total_size : max_total_size;
+
+        /* sample at intervals, and as the payload climbs to its peak */
+        if (footprint_mode &&
+            (i + 1 - foot.last_op >= step ||
+             total_size > foot.last_peak + foot.last_peak / FOOT_PEAK_GRAIN))
+            sample_footprint(&foot, i + 1, total_size);
+
+        if (snap_interval && (i + 1) % snap_interval == 0)
+            snap_take(&snap, i + 1, total_size);
+    }
+    if (snap_interval) {
+        if (trace->num_ops % snap_interval != 0)
+            snap_take(&snap, trace->num_ops, total_size);
+        snap_close(&snap);
+    }
+
+    if (footprint_mode) {
+        sample_footprint(&foot, trace->num_ops, total_size);
+        stats->rss_util = (foot.resident > 0) ? foot.payload / foot.resident : 0;
+        stats->rss_peak = foot.peak;
+    }
+    util = ((double)max_total_size /
+            (double)(mem_heapsize() + mem_side_size()));
+    if (mm_stats_mode)
+        mm_stats(&stats->mm);
+
+    /* drop the touched payload pages, which the timed runs never touch */
+    if (footprint_mode)
+        mem_discard();
+
+    printf(".");
+
+    return util;
+}
+
+
+/*
+ * eval_mm_speed - This is the function that is used by fcyc()
+ *    to measure the running time of the mm malloc package.
+ */
+static void eval_mm_speed(void *ptr)
+{
+    int i, index;
+    size_t size, newsize, n;
+    char *p, *newp, *oldp, *block;
+    trace_t *trace = ((speed_t *)ptr)->trace;
+    reinit_trace(trace);
+
+    /* Reset the heap and initialize the mm package */
+    mem_reset_brk();
+    if (mm_init() < 0)
+        app_error("mm_init failed in eval_mm_speed");
+
+    /* Interpret each trace request */
+    for (i = 0;  i < trace->num_ops;  i++)
+        switch (trace->ops[i].type) {
+
+        case ALLOC: /* mm_malloc */
+            index = trace->ops[i].index;
+            size = trace->ops[i].size;
+            if ((p = mm_malloc(size)) == NULL)
+                app_error("mm_malloc error in eval_mm_speed");
+            trace->blocks[index] = p;
+            break;
+
+        case MEMALIGN: /* mm_memalign */
+            index = trace->ops[i].index;
+            size = trace->ops[i].size;
+            if ((p = mm_memalign(trace->ops[i].arg, size)) == NULL)
+                app_error("mm_memalign error in eval_mm_speed");
+            trace->blocks[index] = p;
+            break;
+
+        case REALLOC: /* mm_realloc */
+            index = trace->ops[i].index;
+            newsize = trace->ops[i].size;
+            oldp = trace->blocks[index];
+            if ((newp = mm_realloc(oldp,newsize)) == NULL && newsize != 0)
+                app_error("mm_realloc error in eval_mm_speed");
+            trace->blocks[index] = newp;
+            break;
+
+        case FREE: /* mm_free */
+            index = trace->ops[i].index;
+            if(index < 0) {
+                block = 0;
+            } else {
+                block = trace->blocks[index];
+            }
+            mm_free(block);
+            break;
+
+        case BATCH_ALLOC: /* mm_malloc_batch */
+            index = trace->ops[i].index;
+            n = trace->ops[i].arg;
+            if (mm_malloc_batch(trace->ops[i].size, n,
+                                (void **)&trace->blocks[index]) != n)
+                app_error("mm_malloc_batch error in eval_mm_speed");
+            break;
+
+        case BATCH_FREE: /* mm_free_batch */
+            index = trace->ops[i].index;
+            mm_free_batch((void **)&trace->blocks[index], trace->ops[i].arg);
+            break;
+
+        default:
+            app_error("Nonexistent request type in eval_mm_speed");
+        }
+}
+
+/*
+ * eval_mm_latency - Replay the trace once more, timing every call to the
+ *    mm package on its own and adding it to the histogram for its type
+ */
+static void eval_mm_latency(trace_t *trace, lat_hist_t *lat)
+{
+    int i, index, type;
+    size_t n;
+    char *p;
+    uint64_t t0, t1;
+
+    reinit_trace(trace);
+    mem_reset_brk();
+    if (mm_init() < 0)
+        app_error("mm_init failed in eval_mm_latency");
+
+    for (i = 0;  i < trace->num_ops;  i++) {
+        type = trace->ops[i].type;
+        index = trace->ops[i].index;
+        switch (type) {
+
+        case ALLOC: /* mm_malloc */
+            t0 = lat_now();
+            p = mm_malloc(trace->ops[i].size);
+            t1 = lat_now();
+            if (p == NULL)
+                app_error("mm_malloc error in eval_mm_latency");
+            trace->blocks[index] = p;
+            break;
+
+        case MEMALIGN: /* mm_memalign */
+            t0 = lat_now();
+            p = mm_memalign(trace->ops[i].arg, trace->ops[i].size);
+            t1 = lat_now();
+            if (p == NULL)
+                app_error("mm_memalign error in eval_mm_latency");
+            trace->blocks[index] = p;
+            break;
+
+        case REALLOC: /* mm_realloc */
+            t0 = lat_now();
+            p = mm_realloc(trace->blocks[index], trace->ops[i].size);
+            t1 = lat_now();
+            if (p == NULL && trace->ops[i].size != 0)
+                app_error("mm_realloc error in eval_mm_latency");
+            trace->blocks[index] = p;
+            break;
+
+        case FREE: /* mm_free */
+            p = (index < 0) ? NULL : trace->blocks[index];
+            t0 = lat_now();
+            mm_free(p);
+            t1 = lat_now();
+            break;
+
+        case BATCH_ALLOC: /* mm_malloc_batch */
+            n = trace->ops[i].arg;
+            t0 = lat_now();
+            if (mm_malloc_batch(trace->ops[i].size, n,
+                                (void **)&trace->blocks[index]) != n)
+                app_error("mm_malloc_batch error in eval_mm_latency");
+            t1 = lat_now();
+            break;
+
+        case BATCH_FREE: /* mm_free_batch */
+            t0 = lat_now();
+            mm_free_batch((void **)&trace->blocks[index], trace->ops[i].arg);
+            t1 = lat_now();
+            break;
+
+        default:
+            app_error("Nonexistent request type in eval_mm_latency");
+        }
+        lat_record(&lat[type], t0, t1);
+    }
+}
+
+/*
+ * The threaded replay (-T). Each thread replays the requests of the
+ * block ids in its shard, in trace order, so that every block is
+ * allocated, resized and freed by one thread. With -X, some frees are
+ * instead handed to the next thread, which makes them from its inbox:
+ * the producer/consumer pattern that stresses allocators most. mm.c
+ * keeps a single heap, so its calls are made under one lock, as in
+ * mm-preload.c.
+ */
+static pthread_mutex_t mm_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Ids go to threads in runs of SHARD_IDS, so threads seldom write
+   the same cache line of trace->blocks */
+#define SHARD_IDS 16
+#define SHARD(index, nthreads) (((index) / SHARD_IDS) % (nthreads))
+
+/* One replay thread */
+typedef struct {
+    pthread_t tid;
+    traceop_t *ops;      /* its requests; batches are split into singles */
+    int num_ops;
+    char **inbox;        /* blocks handed to it by other threads to free */
+    int inbox_len;       /* number it will be handed in all */
+    int inbox_tail;      /* next free slot, claimed atomically */
+    int calls;           /* allocator calls it makes */
+    double secs;         /* time from the start until it finished */
+} mt_thread_t;
+
+/* What the threads of one replay share */
+typedef struct {
+    trace_t *trace;
+    mt_thread_t *thr;
+    pthread_barrier_t start;
+    struct timespec t0;
+} mt_replay_t;
+
+static double mt_since(const struct timespec *t0)
+{
+    struct timespec t1;
+
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    return (t1.tv_sec - t0->tv_sec) + (t1.tv_nsec - t0->tv_nsec) / 1e9;
+}
+
+/*
+ * mt_drain - Free the blocks handed to thread thr so far, starting at
+ *     *head. Returns once the inbox is empty or, if wait is set, once
+ *     every block it will be handed has been freed.
+ */
+static void mt_drain(mt_thread_t *thr, int *head, int wait)
+{
+    char *p;
+
+    while (*head < thr->inbox_len) {
+        if ((p = __atomic_load_n(&thr->inbox[*head], __ATOMIC_ACQUIRE))
+            == NULL) {
+            if (!wait)
+                return;
+            sched_yield();
+            continue;
+        }
+        pthread_mutex_lock(&mm_lock);
+        mm_free(p);
+        pthread_mutex_unlock(&mm_lock);
+        (*head)++;
+    }
+}
+
+/*
+ * mt_replay - Body of a replay thread
+ */
+static void *mt_replay(void *arg)
+{
+    mt_replay_t *r = ((void **)arg)[0];
+    mt_thread_t *thr = ((void **)arg)[1];
+    char **blocks = r->trace->blocks;
+    traceop_t *op;
+    mt_thread_t *to;
+    int i, head = 0, slot;
+    char *p;
+
+    pthread_barrier_wait(&r->start);
+    for (i = 0; i < thr->num_ops; i++) {
+        op = &thr->ops[i];
+        switch (op->type) {
+
+        case ALLOC: /* mm_malloc */
+            pthread_mutex_lock(&mm_lock);
+            p = mm_malloc(op->size);
+            pthread_mutex_unlock(&mm_lock);
+            if (p == NULL)
+                app_error("mm_malloc error in eval_mm_threads");
+            blocks[op->index] = p;
+            break;
+
+        case MEMALIGN: /* mm_memalign */
+            pthread_mutex_lock(&mm_lock);
+            p = mm_memalign(op->arg, op->size);
+            pthread_mutex_unlock(&mm_lock);
+            if (p == NULL)
+                app_error("mm_memalign error in eval_mm_threads");
+            blocks[op->index] = p;
+            break;
+
+        case REALLOC: /* mm_realloc */
+            pthread_mutex_lock(&mm_lock);
+            p = mm_realloc(blocks[op->index], op->size);
+            pthread_mutex_unlock(&mm_lock);
+            if (p == NULL && op->size != 0)
+                app_error("mm_realloc error in eval_mm_threads");
+            blocks[op->index] = p;
+            break;
+
+        case FREE: /* mm_free here, or in thread arg - 1 */
+            p = (op->index < 0) ? NULL : blocks[op->index];
+            if (op->arg != 0) {
+                to = &r->thr[op->arg - 1];
+                slot = __atomic_fetch_add(&to->inbox_tail, 1, __ATOMIC_RELAXED);
+                __atomic_store_n(&to->inbox[slot], p, __ATOMIC_RELEASE);
+            } else {
+                pthread_mutex_lock(&mm_lock);
+                mm_free(p);
+                pthread_mutex_unlock(&mm_lock);
+            }
+            break;
+
+        default:
+            app_error("Nonexistent request type in eval_mm_threads");
+        }
+        mt_drain(thr, &head, 0);
+    }
+    mt_drain(thr, &head, 1);
+    thr->secs = mt_since(&r->t0);
+    return NULL;
+}
+
+/*
+ * mt_shard - Deal the requests of trace out to nthreads threads, splitting
+ *     batches into single calls. A free is handed to the next thread with
+ *     probability handoff_pct%, decided by a hash of its position so that
+ *     every run hands off the same frees. The deal is done twice, first
+ *     only to count each thread's requests, so that each op array holds
+ *     its own share rather than the whole trace.
+ */
+static void mt_shard(trace_t *trace, mt_thread_t *thr, int nthreads)
+{
+    traceop_t *op, single;
+    int i, j, t, n, pass;
+
+    for (t = 0; t < nthreads; t++)
+        memset(&thr[t], 0, sizeof(thr[t]));
+
+    for (pass = 0; pass < 2; pass++) {
+        if (pass == 1) {
+            for (t = 0; t < nthreads; t++) {
+                if ((thr[t].ops = malloc((thr[t].num_ops + 1) * sizeof(traceop_t)))
+                    == NULL)
+                    unix_error("malloc failed in mt_shard");
+                thr[t].num_ops = thr[t].inbox_len = thr[t].calls = 0;
+            }
+        }
+
+        for (i = 0; i < trace->num_ops; i++) {
+            op = &trace->ops[i];
+            n = (op->type == BATCH_ALLOC || op->type == BATCH_FREE) ? op->arg : 1;
+            for (j = 0; j < n; j++) {
+                single = *op;
+                single.index = op->index + j;
+                if (op->type == BATCH_ALLOC || op->type == BATCH_FREE)
+                    single.type = (op->type == BATCH_ALLOC) ? ALLOC : FREE;
+                if (single.type == FREE)
+                    single.arg = 0;
+                t = (single.index < 0) ? 0 : SHARD(single.index, nthreads);
+                if (single.type == FREE && nthreads > 1 && single.index >= 0 &&
+                    (int)(((i + j) * 2654435761u) >> 16) % 100 < handoff_pct) {
+                    single.arg = (t + 1) % nthreads + 1;
+                    thr[single.arg - 1].inbox_len++;
+                    thr[single.arg - 1].calls++;
+                } else {
+                    thr[t].calls++;
+                }
+                if (pass == 1)
+                    thr[t].ops[thr[t].num_ops] = single;
+                thr[t].num_ops++;
+            }
+        }
+    }
+
+    for (t = 0; t < nthreads; t++)
+        if ((thr[t].inbox = malloc((thr[t].inbox_len + 1) * sizeof(char *)))
+            == NULL)
+            unix_error("malloc failed in mt_shard");
+}
+
+/*
+ * eval_mm_threads - Replay the trace with 1 to threads threads, best of
+ *    three runs each, recording the wall time of each thread count and
+ *    Jain's fairness index of the threads' own throughputs
+ */
+static void eval_mm_threads(trace_t *trace, stats_t *stats)
+{
+    mt_thread_t thr[MAX_THREADS];
+    mt_replay_t r;
+    void *args[MAX_THREADS][2];
+    double secs, best, sum, sumsq, tput;
+    int n, t, run;
+
+    r.trace = trace;
+    r.thr = thr;
+    for (n = 1; n <= threads; n++) {
+        mt_shard(trace, thr, n);
+        best = DBL_MAX;
+        for (run = 0; run < 3; run++) {
+            reinit_trace(trace);
+            mem_reset_brk();
+            if (mm_init() < 0)
+                app_error("mm_init failed in eval_mm_threads");
+            for (t = 0; t < n; t++) {
+                memset(thr[t].inbox, 0, thr[t].inbox_len * sizeof(char *));
+                thr[t].inbox_tail = 0;
+            }
+
+            if (pthread_barrier_init(&r.start, NULL, n + 1) != 0)
+                app_error("pthread_barrier_init failed in eval_mm_threads");
+            for (t = 0; t < n; t++) {
+                args[t][0] = &r;
+                args[t][1] = &thr[t];
+                if (pthread_create(&thr[t].tid, NULL, mt_replay, args[t]) != 0)
+                    app_error("pthread_create failed in eval_mm_threads");
+            }
+            clock_gettime(CLOCK_MONOTONIC, &r.t0);
+            pthread_barrier_wait(&r.start);
+            for (t = 0; t < n; t++)
+                pthread_join(thr[t].tid, NULL);
+            secs = mt_since(&r.t0);
+            pthread_barrier_destroy(&r.start);
+
+            if (secs < best) {
+                best = secs;
+                for (t = 0, sum = sumsq = 0; t < n; t++) {
+                    tput = (thr[t].secs > 0) ? thr[t].calls / thr[t].secs : 0;
+                    sum += tput;
+                    sumsq += tput * tput;
+                }
+                stats->mt_fair[n - 1] = (sumsq > 0) ? sum * sum / (n * sumsq) : 1;
+            }
+        }
+        stats->mt_secs[n - 1] = best;
+
+        for (t = 0; t < n; t++) {
+            free(thr[t].ops);
+            free(thr[t].inbox);
+        }
+    }
+}
+
+/*
+ * eval_region_valid - Check the region API (on top of the mm package)
+ *    for correctness. Frees only drop the live block count; when it
+ *    reaches zero the region is reset and all of its memory reused.
+ */
+static int eval_region_valid(trace_t *trace, range_t **ranges)
+{
+    int i;
+    int index;
+    size_t size;
+    size_t k, n;
+    long live = 0;
+    char *newp;
+    char *oldp;
+    char *p;
+    region_t *region;
+
+    /* Reset the heap and free any records in the range tree */
+    mem_reset_brk();
+    clear_ranges(ranges);
+    reinit_trace(trace);
+
+    if (mm_init() < 0) {
+        malloc_error(trace, 0, "mm_init failed.");
+        return 0;
+    }
+    if ((region = region_create(NULL)) == NULL) {
+        malloc_error(trace, 0, "region_create failed.");
+        return 0;
+    }
+
+    for (i = 0;  i < trace->num_ops;  i++) {
+        index = trace->ops[i].index;
+        size = trace->ops[i].size;
+
+        if(debug_mode == DBG_EXPENSIVE) {
+            mm_checkheap(verbose);
+            check_ranges(trace, i, *ranges);
+        }
+
+        switch (trace->ops[i].type) {
+
+        case ALLOC: /* region_alloc */
+        case MEMALIGN: /* region_memalign */
+            if (trace->ops[i].type == ALLOC)
+                p = region_alloc(region, size);
+            else
+                p = region_memalign(region, trace->ops[i].arg, size);
+            if (p == NULL) {
+                malloc_error(trace, i, "region allocation failed.");
+                return 0;
+            }
+            if (trace->ops[i].type == MEMALIGN &&
+                !IS_ALIGNED_TO(p, trace->ops[i].arg)) {
+                malloc_error(trace, i,
+                             "Payload address (%p) not aligned to %u bytes",
+                             p, (unsigned)trace->ops[i].arg);
+                return 0;
+            }
+            if (add_range(ranges, p, size, trace, i, index) == 0)
+                return 0;
+            trace->blocks[index] = p;
+            trace->block_sizes[index] = size;
+            randomize_block(trace, index);
+            live++;
+            break;
+
+        case REALLOC: /* region_realloc */
+            check_index(trace, i, index);
+            oldp = trace->blocks[index];
+            newp = region_realloc(region, oldp, trace->block_sizes[index],
+                                  size);
+            if (newp == NULL && size != 0) {
+                malloc_error(trace, i, "region_realloc failed.");
+                return 0;
+            }
+            remove_range(ranges, oldp);
+            if (size > 0) {
+                if (add_range(ranges, newp, size, trace, i, index) == 0)
+                    return 0;
+            }
+
+            /* Check up to min(size, oldsize) for correct copying */
+            trace->blocks[index] = newp;
+            if (size < trace->block_sizes[index])
+                trace->block_sizes[index] = size;
+            check_index(trace, i, index);
+            trace->block_sizes[index] = size;
+            randomize_block(trace, index);
+
+            /* realloc(NULL, size) adds a block, realloc(p, 0) drops one */
+            if (oldp == NULL)
+                live += (size > 0);
+            else if (size == 0 && --live == 0)
+                region_reset(region);
+            break;
+
+        case FREE: /* nothing, unless this was the last live block */
+            check_index(trace, i, index);
+            if (index != -1) {
+                remove_range(ranges, trace->blocks[index]);
+                if (--live == 0)
+                    region_reset(region);
+            }
+            break;
+
+        case BATCH_ALLOC: /* region_alloc, n times */
+            n = trace->ops[i].arg;
+            for (k = 0; k < n; k++) {
+                if ((p = region_alloc(region, size)) == NULL) {
+                    malloc_error(trace, i, "region_alloc failed.");
+                    return 0;
+                }
+                if (add_range(ranges, p, size, trace, i, index + k) == 0)
+                    return 0;
+                trace->blocks[index + k] = p;
+                trace->block_sizes[index + k] = size;
+                randomize_block(trace, index + k);
+            }
+            live += n;
+            break;
+
+        case BATCH_FREE: /* as for FREE */
+            n = trace->ops[i].arg;
+            for (k = 0; k < n; k++) {
+                check_index(trace, i, index + k);
+                remove_range(ranges, trace->blocks[index + k]);
+            }
+            live -= n;
+            if (live == 0)
+                region_reset(region);
+            break;
+
+        default:
+            app_error("Nonexistent request type in eval_region_valid");
+        }
+    }
+
+    region_destroy(region);
+    return 1;
+}
+
+/*
+ * eval_region_util - Evaluate the space utilization of the region API,
+ *    the same way eval_mm_util does for the mm package
+ */
+static double eval_region_util(trace_t *trace, int tracenum)
+{
+    int i;
+    int index;
+    size_t size, oldsize;
+    size_t k, n;
+    size_t max_total_size = 0;
+    size_t total_size = 0;
+    long live = 0;
+    char *p, *oldp;
+    region_t *region;
+
+    reinit_trace(trace);
+
+    mem_reset_brk();
+    if (mm_init() < 0)
+        app_error("trace %d: mm_init failed in eval_region_util", tracenum);
+    if ((region = region_create(NULL)) == NULL)
+        app_error("trace %d: region_create failed in eval_region_util",
+                  tracenum);
+
+    for (i = 0;  i < trace->num_ops;  i++) {
+        index = trace->ops[i].index;
+        size = trace->ops[i].size;
+
+        switch (trace->ops[i].type) {
+
+        case ALLOC: /* region_alloc */
+        case MEMALIGN: /* region_memalign */
+            if (trace->ops[i].type == ALLOC)
+                p = region_alloc(region, size);
+            else
+                p = region_memalign(region, trace->ops[i].arg, size);
+            if (p == NULL)
+                app_error("trace %d: region allocation failed in "
+                          "eval_region_util", tracenum);
+            trace->blocks[index] = p;
+            trace->block_sizes[index] = size;
+            total_size += size;
+            live++;
+            break;
 
-            total_size += (newsize - oldsize);
+        case REALLOC: /* region_realloc */
+            oldsize = trace->block_sizes[index];
+            oldp = trace->blocks[index];
+            p = region_realloc(region, oldp, oldsize, size);
+            if (p == NULL && size != 0)
+                app_error("trace %d: region_realloc failed in "
+                          "eval_region_util", tracenum);
+            trace->blocks[index] = p;
+            trace->block_sizes[index] = size;
+            total_size += (size - oldsize);
+            if (oldp == NULL)
+                live += (size > 0);
+            else if (size == 0 && --live == 0)
+                region_reset(region);
             break;
 
-        case FREE: /* mm_free */
-            index = trace->ops[i].index;
-            if(index < 0) {
-                size = 0;
-                p = 0;
-            } else {
-                size = trace->block_sizes[index];
-                p = trace->blocks[index];
+        case FREE: /* nothing, unless this was the last live block */
+            if (index != -1) {
+                total_size -= trace->block_sizes[index];
+                if (--live == 0)
+                    region_reset(region);
             }
+            break;
 
-            mm_free(p);
+        case BATCH_ALLOC: /* region_alloc, n times */
+            n = trace->ops[i].arg;
+            for (k = 0; k < n; k++) {
+                if ((p = region_alloc(region, size)) == NULL)
+                    app_error("trace %d: region_alloc failed in "
+                              "eval_region_util", tracenum);
+                trace->blocks[index + k] = p;
+                trace->block_sizes[index + k] = size;
+            }
+            total_size += n * size;
+            live += n;
+            break;
 
-            total_size -= size;
+        case BATCH_FREE: /* as for FREE */
+            n = trace->ops[i].arg;
+            for (k = 0; k < n; k++)
+                total_size -= trace->block_sizes[index + k];
+            live -= n;
+            if (live == 0)
+                region_reset(region);
             break;
 
         default:
-            app_error("trace %d: Nonexistent request type in eval_mm_util",
-                      tracenum);
+            app_error("trace %d: Nonexistent request type in "
+                      "eval_region_util", tracenum);
         }
 
-        /* update the high-water mark */
         max_total_size = (total_size > max_total_size) ?
             total_size : max_total_size;
     }
 
+    region_destroy(region);
     printf(".");
 
-    return ((double)max_total_size / (double)mem_heapsize());
+    return ((double)max_total_size /
+            (double)(mem_heapsize() + mem_side_size()));
 }
 
-
 /*
- * eval_mm_speed - This is the function that is used by fcyc()
- *    to measure the running time of the mm malloc package.
+ * eval_region_speed - This is the function that is used by fcyc()
+ *    to measure the running time of the region API.
  */
-static void eval_mm_speed(void *ptr)
+static void eval_region_speed(void *ptr)
 {
-    int i, index, size, newsize;
-    char *p, *newp, *oldp, *block;
+    int i, index;
+    size_t size, k, n;
+    long live = 0;
+    char *p, *oldp;
+    region_t *region;
     trace_t *trace = ((speed_t *)ptr)->trace;
     reinit_trace(trace);
 
-    /* Reset the heap and initialize the mm package */
     mem_reset_brk();
     if (mm_init() < 0)
-        app_error("mm_init failed in eval_mm_speed");
+        app_error("mm_init failed in eval_region_speed");
+    if ((region = region_create(NULL)) == NULL)
+        app_error("region_create failed in eval_region_speed");
+
+    for (i = 0;  i < trace->num_ops;  i++) {
+        index = trace->ops[i].index;
+        size = trace->ops[i].size;
 
-    /* Interpret each trace request */
-    for (i = 0;  i < trace->num_ops;  i++)
         switch (trace->ops[i].type) {
 
-        case ALLOC: /* mm_malloc */
-            index = trace->ops[i].index;
-            size = trace->ops[i].size;
-            if ((p = mm_malloc(size)) == NULL)
-                app_error("mm_malloc error in eval_mm_speed");
+        case ALLOC: /* region_alloc */
+            if ((p = region_alloc(region, size)) == NULL)
+                app_error("region_alloc error in eval_region_speed");
             trace->blocks[index] = p;
+            trace->block_sizes[index] = size;
+            live++;
             break;
 
-        case REALLOC: /* mm_realloc */
-            index = trace->ops[i].index;
-            newsize = trace->ops[i].size;
+        case MEMALIGN: /* region_memalign */
+            p = region_memalign(region, trace->ops[i].arg, size);
+            if (p == NULL)
+                app_error("region_memalign error in eval_region_speed");
+            trace->blocks[index] = p;
+            trace->block_sizes[index] = size;
+            live++;
+            break;
+
+        case REALLOC: /* region_realloc */
             oldp = trace->blocks[index];
-            if ((newp = mm_realloc(oldp,newsize)) == NULL && newsize != 0)
-                app_error("mm_realloc error in eval_mm_speed");
-            trace->blocks[index] = newp;
+            p = region_realloc(region, oldp, trace->block_sizes[index], size);
+            if (p == NULL && size != 0)
+                app_error("region_realloc error in eval_region_speed");
+            trace->blocks[index] = p;
+            trace->block_sizes[index] = size;
+            if (oldp == NULL)
+                live += (size > 0);
+            else if (size == 0 && --live == 0)
+                region_reset(region);
             break;
 
-        case FREE: /* mm_free */
-            index = trace->ops[i].index;
-            if(index < 0) {
-                block = 0;
-            } else {
-                block = trace->blocks[index];
+        case FREE: /* nothing, unless this was the last live block */
+            if (index != -1 && --live == 0)
+                region_reset(region);
+            break;
+
+        case BATCH_ALLOC: /* region_alloc, n times */
+            n = trace->ops[i].arg;
+            for (k = 0; k < n; k++) {
+                if ((p = region_alloc(region, size)) == NULL)
+                    app_error("region_alloc error in eval_region_speed");
+                trace->blocks[index + k] = p;
+                trace->block_sizes[index + k] = size;
             }
-            mm_free(block);
+            live += n;
+            break;
+
+        case BATCH_FREE: /* as for FREE */
+            live -= trace->ops[i].arg;
+            if (live == 0)
+                region_reset(region);
             break;
 
         default:
-            app_error("Nonexistent request type in eval_mm_speed");
+            app_error("Nonexistent request type in eval_region_speed");
         }
+    }
+
+    region_destroy(region);
 }
 
 /*
@@ -1152,7 +2791,8 @@ static void eval_mm_speed(void *ptr)
  */
 static int eval_libc_valid(trace_t *trace)
 {
-    int i, newsize;
+    int i;
+    size_t newsize, k;
     char *p, *newp, *oldp;
 
     reinit_trace(trace);
@@ -1168,6 +2808,15 @@ static int eval_libc_valid(trace_t *trace)
             trace->blocks[trace->ops[i].index] = p;
             break;
 
+        case MEMALIGN: /* posix_memalign */
+            if (posix_memalign((void **)&p, trace->ops[i].arg,
+                               trace->ops[i].size) != 0) {
+                malloc_error(trace, i, "libc posix_memalign failed");
+                unix_error("System message");
+            }
+            trace->blocks[trace->ops[i].index] = p;
+            break;
+
         case REALLOC: /* realloc */
             newsize = trace->ops[i].size;
             oldp = trace->blocks[trace->ops[i].index];
@@ -1186,6 +2835,21 @@ static int eval_libc_valid(trace_t *trace)
             }
             break;
 
+        case BATCH_ALLOC: /* malloc, one block at a time */
+            for (k = 0; k < trace->ops[i].arg; k++) {
+                if ((p = malloc(trace->ops[i].size)) == NULL) {
+                    malloc_error(trace, i, "libc malloc failed");
+                    unix_error("System message");
+                }
+                trace->blocks[trace->ops[i].index + k] = p;
+            }
+            break;
+
+        case BATCH_FREE: /* free, one block at a time */
+            for (k = 0; k < trace->ops[i].arg; k++)
+                free(trace->blocks[trace->ops[i].index + k]);
+            break;
+
         default:
             app_error("invalid operation type  in eval_libc_valid");
         }
@@ -1202,7 +2866,8 @@ static int eval_libc_valid(trace_t *trace)
 static void eval_libc_speed(void *ptr)
 {
     int i;
-    int index, size, newsize;
+    int index;
+    size_t size, newsize, k;
     char *p, *newp, *oldp, *block;
     trace_t *trace = ((speed_t *)ptr)->trace;
 
@@ -1218,6 +2883,14 @@ static void eval_libc_speed(void *ptr)
             trace->blocks[index] = p;
             break;
 
+        case MEMALIGN: /* posix_memalign */
+            index = trace->ops[i].index;
+            size = trace->ops[i].size;
+            if (posix_memalign((void **)&p, trace->ops[i].arg, size) != 0)
+                unix_error("posix_memalign failed in eval_libc_speed");
+            trace->blocks[index] = p;
+            break;
+
         case REALLOC: /* realloc */
             index = trace->ops[i].index;
             newsize = trace->ops[i].size;
@@ -1237,14 +2910,106 @@ static void eval_libc_speed(void *ptr)
                 free(0);
             }
             break;
+
+        case BATCH_ALLOC: /* malloc, one block at a time */
+            index = trace->ops[i].index;
+            size = trace->ops[i].size;
+            for (k = 0; k < trace->ops[i].arg; k++) {
+                if ((p = malloc(size)) == NULL)
+                    unix_error("malloc failed in eval_libc_speed");
+                trace->blocks[index + k] = p;
+            }
+            break;
+
+        case BATCH_FREE: /* free, one block at a time */
+            index = trace->ops[i].index;
+            for (k = 0; k < trace->ops[i].arg; k++)
+                free(trace->blocks[index + k]);
+            break;
         }
     }
 }
 
+/*
+ * eval_events - Run speed function f once more, outside of the timer,
+ *    with the hardware counters enabled, and record the event counts.
+ *    This is a no-op unless -P was given.
+ */
+static void eval_events(void (*f)(void *), speed_t *speed_params,
+                        stats_t *stats)
+{
+    int j;
+
+    if (!count_events) {
+        for (j = 0; j < PERFCTR_NUM; j++)
+            stats->counters[j] = -1;
+        return;
+    }
+    perfctr_start();
+    f(speed_params);
+    perfctr_stop(stats->counters);
+}
+
+/*
+ * eval_reps - Time speed function f until there are reps timings of the
+ *    trace in all (the first is stats->secs) and record the mean and
+ *    standard deviation of its throughput
+ */
+static void eval_reps(void (*f)(void *), speed_t *speed_params,
+                      stats_t *stats)
+{
+    double kops[reps];
+    double sum, var;
+    int r;
+
+    kops[0] = stats->ops / 1e3 / stats->secs;
+    for (r = 1; r < reps; r++)
+        kops[r] = stats->ops / 1e3 / fsecs(f, speed_params);
+
+    for (r = 0, sum = 0; r < reps; r++)
+        sum += kops[r];
+    stats->kops_mean = sum / reps;
+    for (r = 0, var = 0; r < reps; r++)
+        var += (kops[r] - stats->kops_mean) * (kops[r] - stats->kops_mean);
+    stats->kops_sd = (reps > 1) ? sqrt(var / (reps - 1)) : 0;
+    stats->reps = reps;
+}
+
 /*************************************
  * Some miscellaneous helper routines
  ************************************/
 
+/*
+ * open_counters - Open the hardware counters for -P and say which ones
+ *     are unavailable, and why. Containers and VMs often refuse some or
+ *     all events; their columns then show --.
+ */
+static void open_counters(void)
+{
+    int j, n, err, denied = 0;
+
+    if ((n = perfctr_init()) == PERFCTR_NUM)
+        return;
+    if (n == 0) {
+        err = perfctr_error(0);
+        printf("Hardware counters unavailable (%s); event columns will "
+               "show --.\n", strerror(err));
+        denied = (err == EACCES || err == EPERM);
+    } else {
+        printf("Some hardware counters are unavailable; their columns "
+               "will show --:\n");
+        for (j = 0; j < PERFCTR_NUM; j++) {
+            if ((err = perfctr_error(j)) == 0)
+                continue;
+            printf("  %s: %s\n", perfctr_name(j), strerror(err));
+            denied |= (err == EACCES || err == EPERM);
+        }
+    }
+    if (denied)
+        printf("(lower kernel.perf_event_paranoid, or allow perf_event_open "
+               "in the container)\n");
+}
+
 
 /*
  * printresults - prints a performance summary for some malloc package and returns
@@ -1252,7 +3017,7 @@ static void eval_libc_speed(void *ptr)
  */
 static void printresults(int n, stats_t *stats, sum_stats_t *sumstats)
 {
-    int i;
+    int i, j;
 
     /* weighted sums all */
     double sumsecs = 0;
@@ -1261,11 +3026,32 @@ static void printresults(int n, stats_t *stats, sum_stats_t *sumstats)
     int sum_perf_weight = 0;
     int sum_util_weight = 0;
 
+    /* resident footprint summed over the util-weighted traces */
+    double sumrss = 0;
+
+    /* k-best spreads (secs) of the perf-weighted traces */
+    double sumspread = 0;
+
+    /* event totals over the valid traces, -1 once a trace lacks one */
+    double sumevents[PERFCTR_NUM];
+    double sumevops = 0;
+
     char wstr;
 
+    for (j = 0; j < PERFCTR_NUM; j++)
+        sumevents[j] = 0;
+
     /* Print the individual results for each trace */
-    printf("  %2s%6s %5s%8s%9s  %s\n",
-           "valid", "util", "ops", "secs", "Kops", "trace");
+    printf("  %2s%6s %5s%8s%12s ",
+           "valid", "util", "ops", "secs", "Kops");
+    if (USE_TSC)
+        printf("%7s", "spread");
+    if (footprint_mode)
+        printf("%6s%9s", "rss", "rssKB");
+    if (count_events)
+        for (j = 0; j < PERFCTR_NUM; j++)
+            printf("%10s", perfctr_name(j));
+    printf(" %s\n", "trace");
     for (i=0; i < n; i++) {
         if (stats[i].valid) {
             switch(stats[i].weight)
@@ -1302,10 +3088,39 @@ static void printresults(int n, stats_t *stats, sum_stats_t *sumstats)
             /* print '--' if perf isn't weighted */
             if(stats[i].weight == WNONE || stats[i].weight == WALL
                || stats[i].weight == WPERF)
-                printf("%8.0f%10.6f%6.0f", stats[i].ops, stats[i].secs,
+                printf("%8.0f%10.6f%9.0f", stats[i].ops, stats[i].secs,
                        (stats[i].ops/1e3)/stats[i].secs);
             else
-                printf("%8s%10s%6s", "--", "--", "--");
+                printf("%8s%10s%9s", "--", "--", "--");
+
+            /* how well the K best runs of the timing agree */
+            if (USE_TSC) {
+                if(stats[i].weight == WNONE || stats[i].weight == WALL
+                   || stats[i].weight == WPERF)
+                    printf("  %4.1f%%", stats[i].secs_spread * 100.0);
+                else
+                    printf("%7s", "--");
+            }
+
+            /* time-weighted resident utilization, and peak resident KB */
+            if (footprint_mode)
+                printf(" %4.0f%%%9.0f", stats[i].rss_util * 100.0,
+                       stats[i].rss_peak / 1024);
+
+            /* per-op hardware event rates, '--' where unavailable */
+            if (count_events) {
+                for (j = 0; j < PERFCTR_NUM; j++) {
+                    if (stats[i].counters[j] < 0) {
+                        printf("%10s", "--");
+                        sumevents[j] = -1;
+                    } else {
+                        printf("%10.3f", stats[i].counters[j] / stats[i].ops);
+                        if (sumevents[j] >= 0)
+                            sumevents[j] += stats[i].counters[j];
+                    }
+                }
+                sumevops += stats[i].ops;
+            }
 
             printf(" %s\n", stats[i].filename);
 
@@ -1314,11 +3129,13 @@ static void printresults(int n, stats_t *stats, sum_stats_t *sumstats)
                     sum_perf_weight += 1;
                     sumsecs += stats[i].secs;
                     sumops += stats[i].ops;
+                    sumspread += stats[i].secs * stats[i].secs_spread;
                 }
             if(stats[i].weight == WALL || stats[i].weight == WUTIL)
                 {
                     sum_util_weight += 1;
                     sumutil += stats[i].util;
+                    sumrss += stats[i].rss_util;
                 }
         }
         else {
@@ -1342,13 +3159,26 @@ static void printresults(int n, stats_t *stats, sum_stats_t *sumstats)
 
         double util = (sumutil/(double)sum_util_weight)*100.0;
         double tput = (sumsecs==0.0) ? 0 : (sumops/1e3)/sumsecs;
-        printf("%2d %2d  %5.0f%%%8.0f%10.6f%6.0f\n",
+        printf("%2d %2d  %5.0f%%%8.0f%10.6f%9.0f",
                sum_util_weight,
                sum_perf_weight,
                util,
                sumops,
                sumsecs,
                tput);
+        if (USE_TSC)
+            printf("  %4.1f%%", sumsecs == 0.0 ? 0 : sumspread / sumsecs * 100.0);
+        if (footprint_mode)
+            printf(" %4.0f%%%9s", sumrss / sum_util_weight * 100.0, "");
+        if (count_events) {
+            for (j = 0; j < PERFCTR_NUM; j++) {
+                if (sumevents[j] < 0 || sumevops == 0)
+                    printf("%10s", "--");
+                else
+                    printf("%10.3f", sumevents[j] / sumevops);
+            }
+        }
+        printf("\n");
 
         /* Record the summary statistics so we can compare libc and
            mm.cc */
@@ -1412,12 +3242,491 @@ void malloc_error(const trace_t *trace, int opnum, const char *fmt, ...)
     va_end(ap);
 }
 
+/*
+ * printlatency - Print latency percentiles for each type of call in each
+ *     trace, then for each type over all the traces
+ */
+static void printlatency(int n, stats_t *stats)
+{
+    lat_hist_t *total;
+    int i, t;
+
+    if ((total = calloc(NUM_TYPES, sizeof(*total))) == NULL)
+        unix_error("calloc failed in printlatency");
+
+    printf("Latency in ns (timer overhead of %.0f ns subtracted):\n",
+           lat_overhead());
+    printf("  %-9s%9s%8s%8s%8s%10s %s\n",
+           "call", "count", "p50", "p99", "p99.9", "max", "trace");
+    for (i = 0; i < n; i++) {
+        if (!stats[i].valid)
+            continue;
+        for (t = 0; t < NUM_TYPES; t++) {
+            if (stats[i].lat[t].n == 0)
+                continue;
+            printf("  %-9s%9llu%8.0f%8.0f%8.0f%10.0f %s\n", type_names[t],
+                   (unsigned long long)stats[i].lat[t].n,
+                   lat_quantile(&stats[i].lat[t], 0.5),
+                   lat_quantile(&stats[i].lat[t], 0.99),
+                   lat_quantile(&stats[i].lat[t], 0.999),
+                   lat_max(&stats[i].lat[t]), stats[i].filename);
+            lat_merge(&total[t], &stats[i].lat[t]);
+        }
+    }
+    for (t = 0; t < NUM_TYPES; t++) {
+        if (total[t].n == 0)
+            continue;
+        printf("  %-9s%9llu%8.0f%8.0f%8.0f%10.0f %s\n", type_names[t],
+               (unsigned long long)total[t].n, lat_quantile(&total[t], 0.5),
+               lat_quantile(&total[t], 0.99), lat_quantile(&total[t], 0.999),
+               lat_max(&total[t]), "(all traces)");
+    }
+    free(total);
+}
+
+/*
+ * printmmstats - Print the allocator's counters at the end of each trace:
+ *     heap bytes in use and free, free blocks, the average number of
+ *     free blocks a search looked at, and the splits, coalesces and heap
+ *     extensions it made. With -V, also print the free blocks in each
+ *     size class.
+ */
+static void printmmstats(int n, stats_t *stats)
+{
+    mm_stats_t *st;
+    int i, k;
+
+    printf("Allocator statistics at the end of each trace:\n");
+    printf("  %8s%8s%7s%8s%8s%8s%8s %s\n", "usedKB", "freeKB", "fblks",
+           "probes", "splits", "merges", "extends", "trace");
+    for (i = 0; i < n; i++) {
+        if (!stats[i].valid)
+            continue;
+        st = &stats[i].mm;
+        printf("  %8.0f%8.0f%7zu%8.1f%8lu%8lu%8lu %s\n",
+               st->used_bytes / 1024.0, st->free_bytes / 1024.0,
+               st->free_blocks,
+               st->fits ? (double)st->probes / st->fits : 0.0,
+               st->splits, st->coalesces, st->extends, stats[i].filename);
+        if (verbose > 1) {
+            printf("    free blocks by class (16B, 32B, ...):");
+            for (k = 0; k < MM_STATS_CLASSES; k++)
+                printf(" %zu", st->class_blocks[k]);
+            printf("\n");
+        }
+    }
+}
+
+/*
+ * printthreads - Print the throughput of the threaded replay at each
+ *     thread count, summed over the traces, with its speedup over one
+ *     thread, the scaling efficiency (speedup / threads) and the mean
+ *     fairness. With -V, also print each trace's Kops.
+ */
+static void printthreads(int n, stats_t *stats)
+{
+    cpu_set_t allowed;
+    double ops, secs, fair, kops, kops1 = 0;
+    int i, t, traces, ncpus = 1;
+
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) == 0)
+        ncpus = CPU_COUNT(&allowed);
+    printf("Threaded replay under one lock, %d%% of frees handed off:\n",
+           handoff_pct);
+    if (threads > ncpus)
+        printf("(%d CPU(s) available: past that, threads take turns)\n", ncpus);
+
+    if (verbose > 1) {
+        for (i = 0; i < n; i++) {
+            if (!stats[i].valid)
+                continue;
+            printf("  Kops");
+            for (t = 0; t < threads; t++)
+                printf("%8.0f", stats[i].ops / 1e3 / stats[i].mt_secs[t]);
+            printf(" %s\n", stats[i].filename);
+        }
+    }
+
+    printf("  %7s%10s%9s%7s%10s\n",
+           "threads", "Kops", "speedup", "effic", "fairness");
+    for (t = 0; t < threads; t++) {
+        ops = secs = fair = 0;
+        traces = 0;
+        for (i = 0; i < n; i++) {
+            if (!stats[i].valid)
+                continue;
+            ops += stats[i].ops;
+            secs += stats[i].mt_secs[t];
+            fair += stats[i].mt_fair[t];
+            traces++;
+        }
+        if (traces == 0)
+            return;
+        kops = ops / 1e3 / secs;
+        if (t == 0)
+            kops1 = kops;
+        printf("  %7d%10.0f%9.2f%6.0f%%%10.3f\n", t + 1, kops, kops / kops1,
+               100 * kops / kops1 / (t + 1), fair / traces);
+    }
+}
+
+/*****************************************************************
+ * The following routines write the results in machine-readable form
+ * and compare them with the results of an earlier run (-o and -C).
+ ****************************************************************/
+
+/* Smallest throughput change -C reports, however significant */
+#define MIN_CHANGE 0.02
+
+/* Largest drop in utilization -C tolerates (utilization is exact) */
+#define MAX_UTIL_DROP 0.005
+
+/* A trace's results as read back from a file written by -o */
+typedef struct {
+    char filename[MAXLINE];
+    int valid;
+    double util;
+    double kops_mean;
+    double kops_sd;
+    int reps;
+} base_t;
+
+/*
+ * t95 - Two-sided 95% critical value of Student's t with df degrees
+ *     of freedom
+ */
+static double t95(double df)
+{
+    static const double t[] = {
+        12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262,
+        2.228, 2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101,
+        2.093, 2.086, 2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052,
+        2.048, 2.045, 2.042
+    };
+
+    if (df < 1)
+        return INFINITY;
+    if (df <= 30)
+        return t[(int)df - 1];
+    return 1.960 + 2.4 / df;
+}
+
+/*
+ * ci95 - Half width of the 95% confidence interval of a mean throughput
+ */
+static double ci95(double sd, int n)
+{
+    return (n > 1) ? t95(n - 1) * sd / sqrt(n) : 0;
+}
+
+/*
+ * trace_name - The file name of a trace without its directory, so that
+ *     results from different -t directories can be matched up
+ */
+static const char *trace_name(const char *filename)
+{
+    const char *p = strrchr(filename, '/');
+
+    return p ? p + 1 : filename;
+}
+
+/*
+ * json_put_string - Write s to f as a JSON string
+ */
+static void json_put_string(FILE *f, const char *s)
+{
+    fputc('"', f);
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\')
+            fprintf(f, "\\%c", *s);
+        else if ((unsigned char)*s < 0x20)
+            fprintf(f, "\\u%04x", *s);
+        else
+            fputc(*s, f);
+    }
+    fputc('"', f);
+}
+
+/*
+ * csv_put_string - Write s to f as a quoted CSV field (RFC 4180)
+ */
+static void csv_put_string(FILE *f, const char *s)
+{
+    fputc('"', f);
+    for (; *s; s++) {
+        if (*s == '"')
+            fputc('"', f);
+        fputc(*s, f);
+    }
+    fputc('"', f);
+}
+
+/*
+ * write_results - Write the per-trace and overall results to file, as CSV
+ *     if its name ends in .csv and as JSON otherwise. JSON files have one
+ *     trace per line, which is what compare_results expects.
+ */
+static void write_results(const char *file, int n, stats_t *stats,
+                          sum_stats_t *sumstats, double perfindex)
+{
+    FILE *f;
+    int i, csv;
+    const char *ext = strrchr(file, '.');
+
+    if ((f = fopen(file, "w")) == NULL)
+        unix_error("Could not open %s for the results", file);
+    csv = (ext != NULL && strcmp(ext, ".csv") == 0);
+
+    if (csv)
+        fprintf(f, "trace,valid,weight,util,ops,secs,kops,"
+                "kops_mean,kops_sd,kops_ci95,reps,secs_spread\n");
+    else
+        fprintf(f, "{\"perfindex\": %.1f, \"util\": %.4f, \"kops\": %.1f, "
+                "\"reps\": %d, \"traces\": [\n", perfindex,
+                sumstats->util / 100, sumstats->tput, reps);
+
+    for (i = 0; i < n; i++) {
+        stats_t *st = &stats[i];
+        double kops = st->valid ? st->ops / 1e3 / st->secs : 0;
+
+        if (!st->valid)
+            st->util = st->secs = st->secs_spread = st->kops_mean = st->kops_sd =
+                st->reps = 0;
+        if (csv) {
+            csv_put_string(f, st->filename);
+            fprintf(f, ",%d,%d,%.4f,%.0f,%.6f,%.1f,%.1f,%.1f,%.1f,%d,%.4f\n",
+                    st->valid, st->weight, st->util, st->ops,
+                    st->secs, kops, st->kops_mean, st->kops_sd,
+                    ci95(st->kops_sd, st->reps), st->reps, st->secs_spread);
+        } else {
+            fprintf(f, "  {\"trace\": ");
+            json_put_string(f, st->filename);
+            fprintf(f, ", \"valid\": %d, \"weight\": %d, "
+                    "\"util\": %.4f, \"ops\": %.0f, \"secs\": %.6f, "
+                    "\"secs_spread\": %.4f, "
+                    "\"kops\": %.1f, \"kops_mean\": %.1f, \"kops_sd\": %.1f, "
+                    "\"kops_ci95\": %.1f, \"reps\": %d}%s\n",
+                    st->valid, st->weight, st->util, st->ops,
+                    st->secs, st->secs_spread, kops, st->kops_mean, st->kops_sd,
+                    ci95(st->kops_sd, st->reps), st->reps,
+                    i < n - 1 ? "," : "");
+        }
+    }
+    if (!csv)
+        fprintf(f, "]}\n");
+    if (fclose(f) != 0)
+        unix_error("Could not write the results to %s", file);
+}
+
+/*
+ * json_field - The text after "key": in line, or NULL
+ */
+static const char *json_field(const char *line, const char *key)
+{
+    char pat[64];
+    const char *p;
+
+    snprintf(pat, sizeof(pat), "\"%s\": ", key);
+    return (p = strstr(line, pat)) ? p + strlen(pat) : NULL;
+}
+
+/*
+ * json_number - The number after "key": in line, or def if there is none
+ */
+static double json_number(const char *line, const char *key, double def)
+{
+    const char *p = json_field(line, key);
+    char *end;
+    double v;
+
+    if (p == NULL)
+        return def;
+    v = strtod(p, &end);
+    return (end == p) ? def : v;
+}
+
+/*
+ * json_get_string - Read the JSON string at p into buf (of size len).
+ *     Returns 0 if p holds no complete string or it does not fit.
+ */
+static int json_get_string(const char *p, char *buf, size_t len)
+{
+    size_t n = 0;
+    unsigned int u;
+
+    if (*p++ != '"')
+        return 0;
+    for (; *p != '"'; p++) {
+        if (*p == '\0' || n + 1 >= len)
+            return 0;
+        if (*p == '\\') {
+            p++;
+            if (*p == 'u' && sscanf(p + 1, "%4x", &u) == 1) {
+                buf[n++] = (char)u;
+                p += 4;
+            } else if (*p == '\0') {
+                return 0;
+            } else {
+                buf[n++] = *p;
+            }
+        } else {
+            buf[n++] = *p;
+        }
+    }
+    buf[n] = '\0';
+    return 1;
+}
+
+/*
+ * csv_get_string - Read the CSV field at p, quoted or not, into buf (of
+ *     size len). Returns a pointer just past the field, or NULL if it is
+ *     unterminated or does not fit.
+ */
+static const char *csv_get_string(const char *p, char *buf, size_t len)
+{
+    size_t n = 0;
+    int quoted = (*p == '"');
+
+    for (p += quoted; ; p++) {
+        if (quoted && *p == '"') {
+            if (*++p != '"')
+                break;          /* a doubled quote is a literal quote */
+        } else if (*p == '\0' || (!quoted && (*p == ',' || *p == '\n'))) {
+            if (quoted)
+                return NULL;
+            break;
+        }
+        if (n + 1 >= len)
+            return NULL;
+        buf[n++] = *p;
+    }
+    buf[n] = '\0';
+    return p;
+}
+
+/*
+ * read_results - Read the traces of a file written by write_results.
+ *     Returns the number of traces, with the array in *base.
+ */
+static int read_results(const char *file, base_t **base)
+{
+    FILE *f;
+    char line[4 * MAXLINE], name[MAXLINE];
+    const char *p;
+    int n = 0, cap = 64;
+    base_t *b;
+
+    if ((f = fopen(file, "r")) == NULL)
+        unix_error("Could not open baseline %s", file);
+    if ((*base = malloc(cap * sizeof(base_t))) == NULL)
+        unix_error("malloc failed in read_results");
+
+    while (fgets(line, sizeof(line), f) != NULL) {
+        /* a quoted CSV trace name may hold newlines: join its lines */
+        while (line[0] == '"' && csv_get_string(line, name, sizeof(name))
+               == NULL && strlen(line) < sizeof(line) - 1 &&
+               fgets(line + strlen(line), sizeof(line) - strlen(line), f))
+            ;
+        if (n == cap && (*base = realloc(*base, (cap *= 2) * sizeof(base_t)))
+            == NULL)
+            unix_error("realloc failed in read_results");
+        b = &(*base)[n];
+        if ((p = json_field(line, "trace")) != NULL) {
+            /* a trace needs its name, validity and utilization; files
+               from older drivers lack the throughput statistics */
+            if (!json_get_string(p, b->filename, sizeof(b->filename)) ||
+                json_field(line, "valid") == NULL ||
+                json_field(line, "util") == NULL)
+                continue;
+            b->valid = (int)json_number(line, "valid", 0);
+            b->util = json_number(line, "util", 0);
+            b->kops_mean = json_number(line, "kops_mean",
+                                       json_number(line, "kops", 0));
+            b->kops_sd = json_number(line, "kops_sd", 0);
+            b->reps = (int)json_number(line, "reps", 1);
+        } else if ((p = csv_get_string(line, b->filename,
+                                       sizeof(b->filename))) == NULL ||
+                   sscanf(p, ",%d,%*d,%lf,%*f,%*f,%*f,%lf,%lf,%*f,%d",
+                          &b->valid, &b->util, &b->kops_mean, &b->kops_sd,
+                          &b->reps) != 5) {
+            continue;      /* the CSV header, or the JSON summary */
+        }
+        n++;
+    }
+    fclose(f);
+    if (n == 0)
+        app_error("%s has no results written by mdriver -o", file);
+    return n;
+}
+
+/*
+ * compare_results - Compare each trace with the baseline in file and
+ *     print a table. A trace regresses if its utilization dropped, or if
+ *     its mean throughput dropped by at least MIN_CHANGE and Welch's t
+ *     test says the drop is significant at the 95% level; that needs -n
+ *     runs on both sides. Returns the number of regressions.
+ */
+static int compare_results(const char *file, int n, stats_t *stats)
+{
+    base_t *base, *b;
+    int nbase, i, j, regressed = 0, untested = 0;
+    double se, t, df, v1, v2, change;
+    const char *verdict;
+
+    nbase = read_results(file, &base);
+    printf("Comparison with %s (Kops mean +- 95%% CI):\n", file);
+    printf("  %18s %18s %8s %6s  %s\n", "baseline", "now", "change",
+           "util", "trace");
+
+    for (i = 0; i < n; i++) {
+        for (j = 0, b = NULL; j < nbase && b == NULL; j++)
+            if (!strcmp(trace_name(base[j].filename),
+                        trace_name(stats[i].filename)))
+                b = &base[j];
+        if (b == NULL || !b->valid || !stats[i].valid) {
+            printf("  %18s %18s %8s %6s  %s\n", b && b->valid ? "" : "--",
+                   stats[i].valid ? "" : "invalid", "", "", stats[i].filename);
+            continue;
+        }
+
+        change = (stats[i].kops_mean - b->kops_mean) / b->kops_mean;
+        verdict = "";
+        if (b->reps > 1 && stats[i].reps > 1) {
+            v1 = b->kops_sd * b->kops_sd / b->reps;
+            v2 = stats[i].kops_sd * stats[i].kops_sd / stats[i].reps;
+            se = sqrt(v1 + v2);
+            t = (se > 0) ? fabs(stats[i].kops_mean - b->kops_mean) / se : 0;
+            df = (se > 0) ? (v1 + v2) * (v1 + v2) /
+                (v1 * v1 / (b->reps - 1) + v2 * v2 / (stats[i].reps - 1)) : 1;
+            if (t > t95(df) && fabs(change) >= MIN_CHANGE)
+                verdict = (change < 0) ? "SLOWER" : "faster";
+        } else {
+            untested++;
+        }
+        if (stats[i].util < b->util - MAX_UTIL_DROP)
+            verdict = (*verdict == 'S') ? "SLOWER, UTIL" : "UTIL";
+        regressed += (*verdict == 'S' || *verdict == 'U');
+
+        printf("  %9.0f +-%6.0f %9.0f +-%6.0f %+7.1f%% %+5.1f  %s %s\n",
+               b->kops_mean, ci95(b->kops_sd, b->reps), stats[i].kops_mean,
+               ci95(stats[i].kops_sd, stats[i].reps), change * 100,
+               (stats[i].util - b->util) * 100, stats[i].filename, verdict);
+    }
+    if (untested)
+        printf("Throughput of %d traces not tested: run both sides with "
+               "-n 2 or more.\n", untested);
+    printf("%d regressions.\n\n", regressed);
+    free(base);
+    return regressed;
+}
+
 /*
  * usage - Explain the command line arguments
  */
 static void usage(void)
 {
-    fprintf(stderr, "Usage: mdriver [-hlVdD] [-f <file>]\n");
+    fprintf(stderr, "Usage: mdriver [-hlVdDFLPRS] [-f <file>] [-H <n>] [-j <n>] [-n <n>]\n");
+    fprintf(stderr, "               [-T <n>] [-X <pct>] [-M <n>] [-o <file>] [-C <file>]\n");
     fprintf(stderr, "Options\n");
     fprintf(stderr, "\t-d <i>     Debug: 0 off; 1 default; 2 lots.\n");
     fprintf(stderr, "\t-D         Equivalent to -d2.\n");
@@ -1429,4 +3738,18 @@ static void usage(void)
     fprintf(stderr, "\t-v <i>     Set Verbosity Level to <i>\n");
     fprintf(stderr, "\t-s <s>     Timeout after s secs (default no timeout)\n");
     fprintf(stderr, "\t-f <file>  Use <file> as the trace file.\n");
+    fprintf(stderr, "\t-H <n>     Heap pages: 0 base; 1 transparent huge; 2 hugetlb.\n");
+    fprintf(stderr, "\t-F         Report the heap's resident footprint (time-weighted).\n");
+    fprintf(stderr, "\t-L         Report latency percentiles for each type of call.\n");
+    fprintf(stderr, "\t-S         Report the allocator's statistics (mm_stats) per trace.\n");
+    fprintf(stderr, "\t-P         Report hardware event counts per op (instructions, cycles,\n");
+    fprintf(stderr, "\t           branch, TLB and cache misses).\n");
+    fprintf(stderr, "\t-R         Allocate from a region, reset when no blocks are live.\n");
+    fprintf(stderr, "\t-j <n>     Evaluate <n> traces at once, one per CPU (0: all CPUs).\n");
+    fprintf(stderr, "\t-M <n>     Snapshot the heap every <n> requests into <trace>.snap.\n");
+    fprintf(stderr, "\t-n <n>     Time each trace <n> times, for confidence intervals.\n");
+    fprintf(stderr, "\t-T <n>     Also replay each trace with 1 to <n> threads.\n");
+    fprintf(stderr, "\t-X <pct>   With -T, hand <pct>%% of frees to another thread.\n");
+    fprintf(stderr, "\t-o <file>  Also write the results to <file> (JSON, or CSV if *.csv).\n");
+    fprintf(stderr, "\t-C <file>  Compare with results saved by -o; exit 1 on regressions.\n");
 }
@@ -10,44 +10,214 @@
 #include <sys/mman.h>
 #include <string.h>
 #include <errno.h>
-#include <fcntl.h>
-#include <unistd.h>
+#include <stdint.h>
 
 #include "memlib.h"
 #include "config.h"
 
+/* 
+ * The heap is reserved up front as MAX_HEAP bytes of inaccessible address
+ * space and made readable/writable (committed) only as mem_sbrk reaches
+ * it, so that a very large MAX_HEAP costs nothing until it is used.
+ *
+ * A second, smaller region (the side heap) works the same way and holds
+ * allocator metadata that is kept out of band (see mem_side_sbrk).
+ */
+#define HUGE_PAGE (1<<21)	/* commit granularity for hugetlb heaps */
+#define MAX_SIDE_HEAP (MAX_HEAP/2)
+
+/* A contiguous region that grows like a brk segment */
+typedef struct {
+	char *lo;				/* first byte */
+	char *brk;				/* current break */
+	char *max_addr;			/* end of the reservation */
+	char *commit;			/* end of the read/write part */
+	char *high;				/* highest commit yet: pages below may be resident */
+	size_t commit_unit;		/* commit in multiples of this many bytes */
+} region_t;
+
 /* private variables */
-static char *heap;
-static char *mem_brk;
-static char *mem_max_addr;
+static region_t heap;		/* the heap proper */
+static region_t side;		/* the side heap */
+static int pages_wanted = MEM_PAGES_DEFAULT; /* backing asked for */
+static int pages_used = MEM_PAGES_DEFAULT;   /* backing we actually got */
+
+/*
+ * map_heap - map MAX_HEAP bytes for the heap, trying the requested page
+ *		backing first and falling back to smaller pages when the kernel
+ *		refuses. Records the backing that was obtained in pages_used.
+ */
+static char *map_heap(void){
+	char *p;
+
+#ifdef MAP_HUGETLB
+	/* No MAP_NORESERVE here: we would rather fall back now than take a
+	 * SIGBUS later when the huge page pool runs dry. */
+	if (pages_wanted == MEM_PAGES_HUGETLB) {
+		p = mmap((void *)0x800000000, MAX_HEAP, PROT_NONE,
+				MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+		if (p != MAP_FAILED) {
+			pages_used = MEM_PAGES_HUGETLB;
+			heap.commit_unit = HUGE_PAGE;
+			return p;
+		}
+	}
+#endif
+
+	p = mmap((void *)0x800000000,	/* suggested start*/
+			MAX_HEAP,				/* length */
+			PROT_NONE,				/* permissions (see mem_sbrk) */
+			MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, /* private or shared? */
+			-1,						/* fd */
+			0);						/* offset (dunno) */
+	if (p == MAP_FAILED)
+		return p;
+
+	pages_used = MEM_PAGES_DEFAULT;
+	heap.commit_unit = mem_pagesize();
+#ifdef MADV_HUGEPAGE
+	/* Explicit huge pages unavailable: transparent ones are next best */
+	if (pages_wanted != MEM_PAGES_DEFAULT &&
+			madvise(p, MAX_HEAP, MADV_HUGEPAGE) == 0)
+		pages_used = MEM_PAGES_THP;
+#endif
+	return p;
+}
+
+/*
+ * region_reset - empty region r, revoking access but keeping the pages, so
+ *		every run pays the same system calls to grow it without faulting
+ *		it in again
+ */
+static void region_reset(region_t *r){
+	r->brk = r->lo;
+	if (r->commit > r->lo)
+		mprotect(r->lo, r->commit - r->lo, PROT_NONE);
+	r->commit = r->lo;
+}
+
+/*
+ * region_sbrk - grow region r by incr bytes, committing pages as needed
+ */
+static void *region_sbrk(region_t *r, intptr_t incr){
+	char *old_brk = r->brk;
+	char *new_commit;
+
+	if ( (incr < 0) || (incr > r->max_addr - r->brk) ) {
+		errno = ENOMEM;
+		fprintf(stderr, "ERROR: mem_sbrk failed. Ran out of memory...\n");
+		return (void *)-1;
+	}
+
+	// commit the new pages with a real system call, in an attempt to have
+	// similar semantics (and costs) as a real allocator calling sbrk().
+	if (r->brk + incr > r->commit) {
+		new_commit = r->lo + (((r->brk + incr - r->lo) + r->commit_unit - 1) &
+				~(r->commit_unit - 1));
+		if (new_commit > r->max_addr)
+			new_commit = r->max_addr;
+		if (mprotect(r->commit, new_commit - r->commit,
+					PROT_READ | PROT_WRITE) < 0) {
+			fprintf(stderr, "ERROR: mem_sbrk failed to commit %zu bytes: %s\n",
+					(size_t)(new_commit - r->commit), strerror(errno));
+			errno = ENOMEM;
+			return (void *)-1;
+		}
+		r->commit = new_commit;
+		if (new_commit > r->high)
+			r->high = new_commit;
+	}
+
+	r->brk += incr;
+	return (void *)old_brk;
+}
 
 /* 
  * mem_init - initialize the memory system model
  */
 void mem_init(void){
-	int dev_zero = open("/dev/zero", O_RDWR);
-	heap = mmap((void *)0x800000000, /* suggested start*/
-			MAX_HEAP,				/* length */
-			PROT_WRITE,				/* permissions */
-			MAP_PRIVATE,			/* private or shared? */
-			dev_zero,				/* fd */
-			0);						/* offset (dunno) */
-	mem_max_addr = heap + MAX_HEAP;
-	mem_brk = heap;					/* heap is empty initially */
+	heap.lo = map_heap();
+	side.lo = mmap(NULL, MAX_SIDE_HEAP, PROT_NONE,
+			MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if (heap.lo == MAP_FAILED || side.lo == MAP_FAILED) {
+		fprintf(stderr, "ERROR: mem_init failed to map the heap: %s\n",
+				strerror(errno));
+		exit(1);
+	}
+	heap.max_addr = heap.lo + MAX_HEAP;
+	heap.brk = heap.lo;				/* heap is empty initially */
+	heap.commit = heap.lo;
+	heap.high = heap.lo;
+
+	side.max_addr = side.lo + MAX_SIDE_HEAP;
+	side.brk = side.lo;
+	side.commit = side.lo;
+	side.high = side.lo;
+	side.commit_unit = mem_pagesize();
 }
 
 /* 
  * mem_deinit - free the storage used by the memory system model
  */
 void mem_deinit(void){
-	munmap(heap, MAX_HEAP);
+	munmap(heap.lo, MAX_HEAP);
+	munmap(side.lo, MAX_SIDE_HEAP);
 }
 
 /*
- * mem_reset_brk - reset the simulated brk pointer to make an empty heap
+ * mem_reset_brk - reset the simulated brk pointers to make an empty heap
+ *		and side heap
  */
 void mem_reset_brk(){
-	mem_brk = heap;
+	region_reset(&heap);
+	region_reset(&side);
+}
+
+/*
+ * mem_discard - like mem_reset_brk, but also hand every page the heap and
+ *		side heap ever had back to the kernel, so that mem_resident counts
+ *		only what the next run touches
+ */
+void mem_discard(){
+	mem_reset_brk();
+	madvise(heap.lo, heap.high - heap.lo, MADV_DONTNEED);
+	madvise(side.lo, side.high - side.lo, MADV_DONTNEED);
+	heap.high = heap.lo;
+	side.high = side.lo;
+}
+
+/*
+ * region_resident - count the resident pages of the committed part of r
+ */
+static size_t region_resident(region_t *r){
+	static unsigned char *vec;
+	static size_t vec_len;
+	size_t page = mem_pagesize();
+	size_t n = (r->commit - r->lo) / page;
+	size_t i, resident = 0;
+
+	if (n > vec_len) {
+		free(vec);
+		if ((vec = malloc(n)) == NULL) {
+			vec_len = 0;
+			return 0;
+		}
+		vec_len = n;
+	}
+	if (n == 0 || mincore(r->lo, n * page, vec) < 0)
+		return 0;
+	for (i = 0; i < n; i++)
+		resident += vec[i] & 1;
+	return resident * page;
+}
+
+/*
+ * mem_resident - returns the bytes of the heap and side heap that are
+ *		resident in memory, which may be fewer than mem_heapsize() if the
+ *		allocator never touched some pages or gave them back (madvise)
+ */
+size_t mem_resident(){
+	return region_resident(&heap) + region_resident(&side);
 }
 
 /* 
@@ -55,40 +225,52 @@ void mem_reset_brk(){
  *		by incr bytes and returns the start address of the new area. In
  *		this model, the heap cannot be shrunk.
  */
-void *mem_sbrk(int incr) {
-	char *old_brk = mem_brk;
-
-    // call sbrk() in an attempt to have similar semantics as a real allocator.
-	if ( (incr < 0) || ((mem_brk + incr) > mem_max_addr) ||
-            sbrk(incr) == (void *) -1) {
-		errno = ENOMEM;
-		fprintf(stderr, "ERROR: mem_sbrk failed. Ran out of memory...\n");
-		return (void *)-1;
-	}
-
-	mem_brk += incr;
-	return (void *)old_brk;
+void *mem_sbrk(intptr_t incr) {
+	return region_sbrk(&heap, incr);
 }
 
 /*
  * mem_heap_lo - return address of the first heap byte
  */
 void *mem_heap_lo(){
-	return (void *)heap;
+	return (void *)heap.lo;
 }
 
 /* 
  * mem_heap_hi - return address of last heap byte
  */
 void *mem_heap_hi(){
-	return (void *)(mem_brk - 1);
+	return (void *)(heap.brk - 1);
 }
 
 /*
  * mem_heapsize() - returns the heap size in bytes
  */
 size_t mem_heapsize() {
-	return (size_t)((void *)mem_brk - (void *)heap);
+	return (size_t)(heap.brk - heap.lo);
+}
+
+/* 
+ * mem_side_sbrk - like mem_sbrk, for the side heap. Allocators that keep
+ *		block metadata out of band grow it here, so that the driver can
+ *		charge it to their footprint.
+ */
+void *mem_side_sbrk(intptr_t incr) {
+	return region_sbrk(&side, incr);
+}
+
+/*
+ * mem_side_lo - return address of the first side heap byte
+ */
+void *mem_side_lo(){
+	return (void *)side.lo;
+}
+
+/*
+ * mem_side_size() - returns the side heap size in bytes
+ */
+size_t mem_side_size() {
+	return (size_t)(side.brk - side.lo);
 }
 
 /*
@@ -97,3 +279,33 @@ size_t mem_heapsize() {
 size_t mem_pagesize(){
 	return (size_t)getpagesize();
 }
+
+/*
+ * mem_set_pages - choose the page backing used by the next mem_init().
+ *		One of MEM_PAGES_DEFAULT, MEM_PAGES_THP or MEM_PAGES_HUGETLB.
+ */
+void mem_set_pages(int mode){
+	pages_wanted = mode;
+}
+
+/*
+ * mem_pages - returns the page backing the current heap really has, which
+ *		may be less than was asked for if the kernel lacks huge pages
+ */
+int mem_pages(){
+	return pages_used;
+}
+
+/*
+ * mem_pages_name - returns a printable name for a page backing mode
+ */
+const char *mem_pages_name(int mode){
+	switch (mode) {
+	case MEM_PAGES_THP:
+		return "transparent huge pages";
+	case MEM_PAGES_HUGETLB:
+		return "hugetlb pages";
+	default:
+		return "base pages";
+	}
+}
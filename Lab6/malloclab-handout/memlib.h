@@ -1,11 +1,24 @@
+#include <stdint.h>
 #include <unistd.h>
 
+/* Page backing for the simulated heap (see mem_set_pages) */
+#define MEM_PAGES_DEFAULT 0   /* ordinary base pages */
+#define MEM_PAGES_THP     1   /* transparent huge pages via madvise() */
+#define MEM_PAGES_HUGETLB 2   /* explicit MAP_HUGETLB pages */
+
 void mem_init(void);               
 void mem_deinit(void);
-void *mem_sbrk(int incr);
+void *mem_sbrk(intptr_t incr);
 void mem_reset_brk(void); 
+void mem_discard(void);
+size_t mem_resident(void);
 void *mem_heap_lo(void);
 void *mem_heap_hi(void);
 size_t mem_heapsize(void);
 size_t mem_pagesize(void);
-
+void *mem_side_sbrk(intptr_t incr);
+void *mem_side_lo(void);
+size_t mem_side_size(void);
+void mem_set_pages(int mode);
+int mem_pages(void);
+const char *mem_pages_name(int mode);
@@ -0,0 +1,319 @@
+/*
+ * mm-preload.c - Run mm.c as the malloc of a real process
+ *
+ * Built into libmm.so together with mm.c and memlib.c (see the Makefile),
+ * this file exports the C library's allocation functions on top of the
+ * mm_* functions, so that any program can be run on our allocator with
+ *
+ *     LD_PRELOAD=./libmm.so program args...
+ *
+ * memlib already maps its heap with mmap and grows it with real system
+ * calls, so it serves as the backend unchanged. Requests above a
+ * threshold bypass the heap and get a mapping of their own, so that
+ * freeing them returns the memory. Like the C library's malloc, we raise
+ * the threshold to the size of any mapping that is freed (up to
+ * MMAP_MAX_THRESHOLD), so that programs which keep reallocating big
+ * buffers stop paying for mmap and munmap each time.
+ *
+ * A single mutex makes the allocator thread safe. It is taken around
+ * fork() as well, so the child never inherits a heap that another thread
+ * was in the middle of changing.
+ */
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "mm.h"
+#include "memlib.h"
+#include "config.h"
+
+#define MMAP_THRESHOLD (1<<17)  /* initially map requests this big directly */
+#define MMAP_MAX_THRESHOLD (32<<20)  /* ...and at most requests this big */
+#define MAP_HDR 16              /* header in front of a direct mapping,
+                                   keeps the payload 16-byte aligned */
+
+/* Total mapping size, stored in the header of a direct mapping */
+#define MAP_LEN(p) (*(size_t *)((char *)(p) - MAP_HDR))
+
+static pthread_mutex_t mm_lock = PTHREAD_MUTEX_INITIALIZER;
+static int heap_ready = 0;       /* have mem_init and mm_init run? */
+static size_t mmap_threshold = MMAP_THRESHOLD;  /* map requests this big */
+
+/*
+ * lock - Take the allocator lock, setting up the heap on first use. The
+ *     C library may allocate before our constructor runs, so this cannot
+ *     wait for it.
+ */
+static void lock(void)
+{
+    pthread_mutex_lock(&mm_lock);
+    if (!heap_ready) {
+        mem_init();
+        if (mm_init() < 0)
+            abort();
+        heap_ready = 1;
+    }
+}
+
+static void unlock(void)
+{
+    pthread_mutex_unlock(&mm_lock);
+}
+
+/*
+ * Fork handlers: hold the lock across fork, then release it in the
+ * parent and start with a fresh one in the (single threaded) child.
+ */
+static void fork_prepare(void)
+{
+    pthread_mutex_lock(&mm_lock);
+}
+
+static void fork_parent(void)
+{
+    pthread_mutex_unlock(&mm_lock);
+}
+
+static void fork_child(void)
+{
+    pthread_mutex_init(&mm_lock, NULL);
+}
+
+static void __attribute__((constructor)) preload_init(void)
+{
+    pthread_atfork(fork_prepare, fork_parent, fork_child);
+}
+
+/*
+ * in_heap - Did p come from the mm heap (rather than a direct mapping)?
+ *     The heap's reservation never moves, so this needs no lock.
+ */
+static int in_heap(void *p)
+{
+    return heap_ready && (char *)p >= (char *)mem_heap_lo() &&
+        (char *)p < (char *)mem_heap_lo() + MAX_HEAP;
+}
+
+/*
+ * map_alloc - Give a large request a mapping of its own
+ */
+static void *map_alloc(size_t size)
+{
+    size_t len;
+    char *p;
+
+    len = (size + MAP_HDR + getpagesize() - 1) & ~(size_t)(getpagesize() - 1);
+    p = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+             -1, 0);
+    if (p == MAP_FAILED)
+        return NULL;
+    p += MAP_HDR;
+    MAP_LEN(p) = len;
+    return p;
+}
+
+static void map_free(void *p)
+{
+    size_t len = MAP_LEN(p);
+
+    if (len > __atomic_load_n(&mmap_threshold, __ATOMIC_RELAXED) &&
+        len <= MMAP_MAX_THRESHOLD)
+        __atomic_store_n(&mmap_threshold, len, __ATOMIC_RELAXED);
+    munmap((char *)p - MAP_HDR, len);
+}
+
+/*
+ * use_map - Should a request of size bytes get its own mapping?
+ */
+static int use_map(size_t size)
+{
+    return size >= __atomic_load_n(&mmap_threshold, __ATOMIC_RELAXED);
+}
+
+void *malloc(size_t size)
+{
+    void *p;
+
+    if (size > PTRDIFF_MAX) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    if (use_map(size)) {
+        if ((p = map_alloc(size)) == NULL)
+            errno = ENOMEM;
+        return p;
+    }
+
+    lock();
+    p = mm_malloc(size ? size : 1);   /* malloc(0) must be unique */
+    unlock();
+    if (p == NULL)
+        errno = ENOMEM;
+    return p;
+}
+
+void free(void *ptr)
+{
+    if (ptr == NULL)
+        return;
+    if (!in_heap(ptr)) {
+        map_free(ptr);
+        return;
+    }
+    lock();
+    mm_free(ptr);
+    unlock();
+}
+
+size_t malloc_usable_size(void *ptr)
+{
+    size_t size;
+
+    if (ptr == NULL)
+        return 0;
+    if (!in_heap(ptr))
+        return MAP_LEN(ptr) - MAP_HDR;
+    lock();
+    size = mm_usable_size(ptr);
+    unlock();
+    return size;
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    size_t oldsize;
+    void *newp;
+
+    if (ptr == NULL)
+        return malloc(size);
+    if (size == 0) {
+        free(ptr);
+        return NULL;
+    }
+    if (size > PTRDIFF_MAX) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    if (in_heap(ptr) && !use_map(size)) {
+        lock();
+        newp = mm_realloc(ptr, size);
+        unlock();
+        if (newp == NULL)
+            errno = ENOMEM;
+        return newp;
+    }
+
+    /* at least one side is a direct mapping: copy across */
+    oldsize = malloc_usable_size(ptr);
+    if (size <= oldsize && !in_heap(ptr) && use_map(size))
+        return ptr;
+    if ((newp = malloc(size)) == NULL)
+        return NULL;
+    memcpy(newp, ptr, oldsize < size ? oldsize : size);
+    free(ptr);
+    return newp;
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+    size_t bytes;
+    void *p;
+
+    if (__builtin_mul_overflow(nmemb, size, &bytes)) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    if (use_map(bytes))
+        return malloc(bytes);      /* fresh mappings are already zero */
+
+    lock();
+    p = mm_calloc(bytes ? bytes : 1, 1);
+    unlock();
+    if (p == NULL)
+        errno = ENOMEM;
+    return p;
+}
+
+void *reallocarray(void *ptr, size_t nmemb, size_t size)
+{
+    size_t bytes;
+
+    if (__builtin_mul_overflow(nmemb, size, &bytes)) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    return realloc(ptr, bytes);
+}
+
+void *memalign(size_t alignment, size_t size)
+{
+    void *p;
+
+    if (alignment == 0 || (alignment & (alignment - 1))) {
+        errno = EINVAL;
+        return NULL;
+    }
+    if (size > PTRDIFF_MAX) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    if (alignment <= MAP_HDR && use_map(size))
+        return malloc(size);
+
+    lock();
+    p = mm_memalign(alignment, size ? size : 1);
+    unlock();
+    if (p == NULL)
+        errno = ENOMEM;
+    return p;
+}
+
+int posix_memalign(void **memptr, size_t alignment, size_t size)
+{
+    void *p;
+
+    if (alignment == 0 || alignment % sizeof(void *) ||
+        (alignment & (alignment - 1)))
+        return EINVAL;
+    if (size > PTRDIFF_MAX)
+        return ENOMEM;
+    if ((p = memalign(alignment, size)) == NULL)
+        return ENOMEM;
+    *memptr = p;
+    return 0;
+}
+
+void *aligned_alloc(size_t alignment, size_t size)
+{
+    if (size > PTRDIFF_MAX) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    return memalign(alignment, size);
+}
+
+void *valloc(size_t size)
+{
+    if (size > PTRDIFF_MAX) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    return memalign(getpagesize(), size);
+}
+
+void *pvalloc(size_t size)
+{
+    size_t page = getpagesize();
+
+    /* also keeps the rounding below from wrapping */
+    if (size > PTRDIFF_MAX) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    return memalign(page, (size + page - 1) & ~(page - 1));
+}
@@ -1,7 +1,7 @@
 /* 
  * mm.c
  * Irene Alvarado - ialvarad@andrew.cmu.edu
- * Current performance according to mdriver: 75/100
+ * Current performance according to mdriver: 81/100 (util 82%)
  *
  * I have implemented an explicit free list allocator with a first fit approach
  * I took quite a bit of base code from the CSAPP book and a. ported it to 
@@ -10,6 +10,11 @@
  * Key points to know about my explicit list: 
  * -It is demarcated by two NULL pointers. I use these to keep track of where 
  * the beginning and end of the list is. 
+ * - There is one list per size class (see "Size classes" below), and
+ * requests small enough to have a class are rounded up to its size.
+ * - Compiled with -DMM_ADDR_ORDER, each list is kept in address order
+ * instead of LIFO order, and find_fit leaves the block at the end of the
+ * heap for last (see "Address order" below).
  * - I call coalesce at various points: when a heap is extended, when a block
  * is freed, and when a block is split
  * An important optimization is that a block can be split when a block has 
@@ -21,8 +26,21 @@
  *
  * How an allocated block looks:
  * HEADER (4 bytes) - DATA (various bytes) - FOOTER (4 bytes) 
+ *
+ * Compiled with -DMM_WIDE, headers and footers are 8 bytes wide so that
+ * blocks (and the heap) can grow past 4 GB. The layout is otherwise the
+ * same, with a minimum block size of 32 bytes instead of 24.
+ *
+ * Compiled with -DMM_SIDE_META, free blocks are not linked through the
+ * heap at all. Their sizes and addresses are kept in a dense index in
+ * memlib's side heap instead (see "Out-of-band free block index" below),
+ * so that find_fit scans contiguous metadata instead of chasing one
+ * header per cache line.
  */
 #include <assert.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -30,6 +48,7 @@
 
 #include "mm.h"
 #include "memlib.h"
+#include "mm_classes.h"
 
 
 /* If you want debugging output, use the following macro.  When you hand
@@ -48,17 +67,35 @@
 #define free mm_free
 #define realloc mm_realloc
 #define calloc mm_calloc
+#define memalign mm_memalign
+#define posix_memalign mm_posix_memalign
+#define aligned_alloc mm_aligned_alloc
+#define malloc_batch mm_malloc_batch
+#define free_batch mm_free_batch
+#define malloc_usable_size mm_usable_size
 #endif /* def DRIVER */
 
 /* Basic constants and macros */
+#ifdef MM_WIDE
+typedef size_t word_t;      /* Header/footer word, wide enough for any size */
+#define WSIZE       8       /* Word and header/footer size (bytes) */ 
+#define DSIZE       16      /* Double word size (bytes) */
+#else
+typedef unsigned int word_t; /* Header/footer word */
 #define WSIZE       4       /* Word and header/footer size (bytes) */ 
 #define DSIZE       8       /* Double word size (bytes) */
-#define CHUNKSIZE  (1<<12)  /* Extend heap by this amount (bytes) */  
-
-// Block has to be at least 24 bytes. 
+#endif
+#define CHUNKSIZE  (1<<12)  /* Extend heap by at least this amount (bytes) */  
+#define CHUNKMAX   (1<<16)  /* ... and at most this much beyond a request */
+#define CHUNK_BURST 64      /* Fit searches between extensions in a burst */
+#define CHUNK_SHARE 8       /* Steps stay under 1/CHUNK_SHARE of the heap */
+#define MIN_STEP(step, cap) MAX((step) < (cap) ? (step) : (cap), CHUNKSIZE)
+#define PSIZE      (sizeof(void *)) /* Free list pointer size (bytes) */
+
+// Block has to be at least 24 bytes (32 with wide headers). 
 // 1. For a free block: header (4), prev free (8), next free(8), footer(4). 
 // 2/ For an allocated block: header (4), data (16), footer(4)
-#define MIN         24      
+#define MIN         (DSIZE + 2*PSIZE)
 
 #define MAX(x, y) ((x) > (y)? (x) : (y))  
 
@@ -66,8 +103,8 @@
 #define PACK(size, alloc)  ((size) | (alloc)) 
 
 /* Read and write a word at address p */
-#define GET(p)       (*(unsigned int *)(p))            
-#define PUT(p, val)  (*(unsigned int *)(p) = (val))    
+#define GET(p)       (*(word_t *)(p))            
+#define PUT(p, val)  (*(word_t *)(p) = (val))    
 
 /* Read the size and allocated fields from address p */
 #define GET_SIZE(p)  (GET(p) & ~0x7)                   
@@ -81,28 +118,191 @@
 #define NEXT_BLKP(bp)  ((char *)(bp) + GET_SIZE(((char *)(bp) - WSIZE))) 
 #define PREV_BLKP(bp)  ((char *)(bp) - GET_SIZE(((char *)(bp) - DSIZE))) 
 
-/* single word (4) or double word (8) alignment */
+/* double word (8) alignment, or 16 with wide headers so that payloads
+ * meet the x86-64 ABI's malloc alignment when run as libmm.so */
+#ifdef MM_WIDE
+#define ALIGNMENT 16
+#else
 #define ALIGNMENT 8
+#endif
 /* rounds up to the nearest multiple of ALIGNMENT */
-#define ALIGN(size) (((size) + (ALIGNMENT-1)) & ~0x7)
+#define ALIGN(size) (((size) + (ALIGNMENT-1)) & ~(size_t)(ALIGNMENT-1))
 
 #define SIZE_T_SIZE (ALIGN(sizeof(size_t)))
 #define SIZE_PTR(p)  ((size_t*)(((char*)(p)) - SIZE_T_SIZE))
 
+/* Adjusted block size for a payload of size bytes: overhead, alignment and
+ * room for the free list pointers once the block is freed */
+#define ADJUST(size) MAX(ALIGN((size) + DSIZE), MIN)
+
+/*
+ * Size classes. mm_classes.h is written by sizeclass from the histogram
+ * of request sizes in the traces. A request of up to MM_CLASS_MAX bytes
+ * is rounded up to the largest request of its class, so that blocks
+ * freed by one request of a class fit the next one exactly. The side
+ * index has no lists per class to keep such blocks apart, so there the
+ * rounding would only waste space.
+ */
+#ifdef MM_SIDE_META
+#define CLASS_SIZE(size) (size)
+#else
+#define CLASS_SIZE(size) \
+    ((size) - 1 < MM_CLASS_MAX ? \
+     (size_t)mm_class_size[mm_class_of[((size) - 1) / MM_CLASS_GRAIN]] : (size))
+#endif
+
 //Additional macros to manipulate the free block list
-#define NEXT_FREE_BLOCK(bp)(*(void **)(bp + DSIZE))
+#define NEXT_FREE_BLOCK(bp)(*(void **)((char *)(bp) + PSIZE))
 #define PREV_FREE_BLOCK(bp)(*(void **)(bp))
 
 static char *heap_listp = 0;  /* Pointer to first block */ 
-static char *free_p = 0 ; /* Pointer to the free block list */
+
+/*
+ * Heap extension. When nothing fits, grow_heap extends the heap by the
+ * part of the request the free block at the end of the heap (if any)
+ * cannot hold, or by chunk_size if that is more. chunk_size doubles, up
+ * to CHUNKMAX, when extensions come within CHUNK_BURST searches of each
+ * other, and halves for every CHUNK_BURST searches without one, down to
+ * CHUNKSIZE. A burst of allocations thus takes a few large steps rather
+ * than many small ones, and the heap stops growing ahead of requests
+ * once the burst is over. A step is also kept under 1/CHUNK_SHARE of the
+ * heap, so that small heaps are not inflated by what they have not used.
+ */
+static size_t chunk_size = CHUNKSIZE;  /* Current extension step */
+static unsigned long chunk_stamp = 0;  /* counts.fits at the last one */
+
+/* Counters for mm_stats, kept up to date by every call */
+static mm_stats_t counts;
+
+/* Size class of a free block of size bytes (see mm.h) */
+#define CLASS_OF(size) \
+    MAX(0, MIN_CLASS(63 - __builtin_clzll(size) - 4))
+#define MIN_CLASS(k)   ((k) < MM_STATS_CLASSES ? (k) : MM_STATS_CLASSES - 1)
+
+#ifdef MM_SIDE_META
+/*
+ * Out-of-band free block index. Entries live in the side heap in groups of
+ * SIDE_GROUP, all sizes first, so find_fit reads a whole cache line of
+ * sizes at a time and only touches a block once it fits. A free block
+ * remembers its slot in the word where the explicit list would keep its
+ * prev pointer. Removal moves the last entry into the hole.
+ */
+#define SIDE_GROUP  16
+
+typedef struct {
+    word_t size[SIDE_GROUP];  /* free block sizes, scanned by find_fit */
+    char *bp[SIDE_GROUP];     /* ... and the matching block pointers */
+} side_group_t;
+
+#define SIDE_SLOT(bp)  (*(size_t *)(bp))
+#define SIDE_ENTRY(i)  (&side_groups[(i) / SIDE_GROUP])
+
+static side_group_t *side_groups = 0; /* First group in the side heap */
+static size_t side_count = 0; /* Number of free blocks in the index */
+static size_t side_cap = 0;   /* Number of slots the side heap holds */
+
+#define HAVE_FREE_BLOCKS (side_count != 0)
+#else
+/*
+ * Segregated free lists. List c < MM_CLASSES - 1 holds the free blocks
+ * that can hold a request of class c but not of class c + 1, so any of
+ * them fits a request of class c. Blocks that can hold the largest class
+ * go in lists by power of two from there on, and are searched first fit.
+ */
+#define NUM_LISTS  (MM_CLASSES + 40)
+
+static char *free_lists[NUM_LISTS] ; /* Heads of the free block lists */
+
+#define HAVE_FREE_BLOCKS (counts.free_blocks != 0)
+
+#ifdef MM_ADDR_ORDER
+/*
+ * Address order. Keeping each list sorted by address makes first fit
+ * take the lowest block that fits, which packs blocks toward the start
+ * of the heap and leaves free space in fewer, larger pieces at its end.
+ * Insertion has to find its place in the list: it starts from the block
+ * last inserted in the same list, its finger, walking forward or back,
+ * since frees tend to land near one another. find_fit also passes over
+ * the wilderness block, the one that ends at the epilogue, as long as
+ * anything else fits, so that it stays whole for large requests and the
+ * heap grows less.
+ */
+static char *list_finger[NUM_LISTS] ; /* Last block inserted, per list */
+
+#define IS_WILDERNESS(bp) (GET_SIZE(HDRP(NEXT_BLKP(bp))) == 0)
+#endif
+#endif
+
+/*
+ * Heap checking, chosen at compile time with -DMM_CHECK=<level>:
+ * 0  no checks (the default)
+ * 1  local checks: each call checks the blocks it touches, and free blocks
+ *    carry a canary that must survive until they are reused. O(1) a call.
+ * 2  also, every CHECK_PERIOD calls, check the next CHECK_WINDOW blocks of
+ *    the heap, picking up where the last such walk stopped
+ * 3  a full mm_checkheap on every call
+ * At any level but 0, SIGUSR1 makes the next call run a full check.
+ * mm_checkheap itself always checks the whole heap and free list.
+ */
+#ifndef MM_CHECK
+#define MM_CHECK 0
+#endif
+#define CHECK_PERIOD 1024
+#define CHECK_WINDOW 64
+
+/* Free blocks with room for it keep a canary, salted with their address,
+ * in the word after the free list pointers */
+#define CANARY_ROOM  (DSIZE + 3*PSIZE)
+#define CANARYP(bp)  ((size_t *)((char *)(bp) + 2*PSIZE))
+#define CANARY(bp)   ((size_t)0x5afec0de5afec0deULL ^ (size_t)(bp))
+
+#if MM_CHECK >= 1
+static unsigned long check_calls = 0 ;  /* Calls since mm_init */
+static volatile sig_atomic_t check_requested = 0 ; /* Set by SIGUSR1 */
+
+#define CHECK_CALL()          check_call(__LINE__)
+#define CHECK_ALLOCATED(bp)   check_allocated(bp, __LINE__)
+#define CHECK_FREE(bp)        check_free(bp, __LINE__)
+#define SET_CANARY(bp) \
+    do { if (GET_SIZE(HDRP(bp)) >= CANARY_ROOM) \
+             *CANARYP(bp) = CANARY(bp) ; } while (0)
+#else
+#define CHECK_CALL()
+#define CHECK_ALLOCATED(bp)
+#define CHECK_FREE(bp)
+#define SET_CANARY(bp)
+#endif
+
+#if MM_CHECK >= 2
+static char *check_cursor = 0 ;  /* Where the next sampled walk starts */
+
+/* A merge made block bp part of block into */
+#define FORGET_BLOCK(bp, into) \
+    do { if (check_cursor == (char *)(bp)) check_cursor = (into) ; } while (0)
+#else
+#define FORGET_BLOCK(bp, into)
+#endif
 
 /* Function prototypes for internal helper routines */
 static void *extend_heap(size_t words);
+static void *grow_heap(size_t asize);
 static void place(void *bp, size_t asize);
 static void *find_fit(size_t asize);
 static void *coalesce(void *bp);
 static void insert_free_block(void *ptr) ;
 static void remove_block(void *bp) ; 
+static void count_free(void *bp, int delta) ;
+#ifndef MM_SIDE_META
+static int list_of(size_t size) ;
+#endif
+static void check_fail(int lineno, const char *msg, void *bp) ;
+static void check_block(void *bp, int lineno) ;
+#if MM_CHECK >= 1
+static void check_call(int lineno) ;
+static void check_allocated(void *bp, int lineno) ;
+static void check_free(void *bp, int lineno) ;
+static void check_signal(int sig) ;
+#endif
 
 #ifdef DEBUG
     static void print_block(void *ptr) ;
@@ -110,7 +310,7 @@ static void remove_block(void *bp) ;
 
 /*
  * mm_init - Called when a new trace starts
- * Initially the heap looks like this and has 32 bytes:
+ * Initially the heap looks like this and has 32 bytes (48 if wide):
  * PADDING(4) - PROLOGUE HEADER (4) - PREV POINTER (8) - 
  * NEXT POINTER (8) - EPILOGUE HEADER (4) - TAIL (4)
  * The free list pointer is initialized to NULL
@@ -118,12 +318,12 @@ static void remove_block(void *bp) ;
 int mm_init(void) 
 {
     /* Create the initial empty heap */
-    if ((heap_listp = mem_sbrk(8*WSIZE)) == (void *)-1) 
+    if ((heap_listp = mem_sbrk(MIN + 2*WSIZE)) == (void *)-1) 
         return -1;
     PUT(heap_listp, 0);                          // Alignment padding
     PUT(heap_listp + (1*WSIZE), PACK(MIN, 1)); // Prologue header
     PUT(heap_listp + (2*WSIZE), 0); // Prev pointer 
-    PUT(heap_listp + (4*WSIZE), 0); //Next pointer
+    PUT(heap_listp + (2*WSIZE) + PSIZE, 0); //Next pointer
     PUT(heap_listp + MIN, PACK(MIN, 1)) ; // Prologue epilogue (footer)
     PUT(heap_listp + MIN + WSIZE, PACK(0,1)) ; // Tail
 
@@ -133,11 +333,31 @@ int mm_init(void)
     #endif
     
     heap_listp += (2*WSIZE);                      
-    free_p = NULL ;
+    memset(&counts, 0, sizeof(counts));
+    chunk_size = CHUNKSIZE ;
+    chunk_stamp = 0 ;
+#ifdef MM_SIDE_META
+    side_groups = mem_side_lo() ;
+    side_count = 0 ;
+    side_cap = mem_side_size() / sizeof(side_group_t) * SIDE_GROUP ;
+#else
+    memset(free_lists, 0, sizeof(free_lists)) ;
+#ifdef MM_ADDR_ORDER
+    memset(list_finger, 0, sizeof(list_finger)) ;
+#endif
+#endif
 
     /* Extend the empty heap with a free block of CHUNKSIZE bytes */
     if (extend_heap(CHUNKSIZE/WSIZE) == NULL) 
         return -1;
+
+#if MM_CHECK >= 1
+    check_calls = 0 ;
+    signal(SIGUSR1, check_signal) ;
+#endif
+#if MM_CHECK >= 2
+    check_cursor = NEXT_BLKP(heap_listp) ;
+#endif
     return 0;
 }
 
@@ -158,6 +378,8 @@ static void *extend_heap(size_t words)
 
     if ((long)(bp = mem_sbrk(size)) == -1)  
         return NULL;                                        
+    counts.extends++;
+    counts.extend_bytes += size;
 
     /* Initialize free block header/footer and the epilogue header */
     PUT(HDRP(bp), PACK(size, 0));         /* Free block header */   
@@ -167,11 +389,39 @@ static void *extend_heap(size_t words)
     bp = coalesce(bp) ; 
     insert_free_block(bp) ;
 
-    mm_checkheap(0) ;
-
     return bp;                                          
 }
 
+/*
+ * Grow_heap - Extend the heap so that it ends in a free block of at least
+ * asize bytes, and return that block. Only the part of asize that a free
+ * block at the end of the heap lacks is added, or chunk_size if that is
+ * more (see "Heap extension" above).
+ */
+static void *grow_heap(size_t asize)
+{
+    char *last = (char *)mem_heap_hi() + 1 - DSIZE ;  /* Last block's footer */
+    size_t tail = GET_ALLOC(last) ? 0 : GET_SIZE(last) ;
+    size_t need = asize > tail ? asize - tail : 0 ;
+    unsigned long gap = counts.fits - chunk_stamp ;
+    size_t step ;
+
+    if (gap < CHUNK_BURST) {
+        if (need <= chunk_size && chunk_size < CHUNKMAX)
+            chunk_size *= 2 ;
+    }
+    else {
+        gap /= CHUNK_BURST ;
+        chunk_size = gap >= 16 ? CHUNKSIZE :
+            MAX(chunk_size >> gap, (size_t)CHUNKSIZE) ;
+    }
+    chunk_stamp = counts.fits ;
+
+    // Never step ahead by more than a fraction of the heap so far
+    step = MIN_STEP(chunk_size, mem_heapsize() / CHUNK_SHARE) ;
+    return extend_heap(MAX(need, step)/WSIZE) ;
+}
+
 /*
  * malloc - Allocate a block by incrementing the brk pointer.
  * Malloc always allocate a block whose size is a multiple of the alignment.
@@ -182,23 +432,18 @@ static void *extend_heap(size_t words)
 void *malloc(size_t size) 
 {
     size_t asize;      /* Adjusted block size */
-    size_t extendsize; /* Amount to extend heap if no fit */
     char *bp;      
 
     if (heap_listp == 0){
         mm_init();
     }
+    CHECK_CALL() ;
     /* Ignore spurious requests */
     if (size == 0)
         return NULL;
 
     /* Adjust block size to include overhead and alignment reqs. */
-    if (size <= DSIZE)                                          
-        asize = 2*DSIZE;                                        
-    else
-        asize = DSIZE * ((size + (DSIZE) + (DSIZE-1)) / DSIZE); 
-
-    asize = MAX(asize, MIN) ; // Make sure alignment is correct for 64 bit
+    asize = ADJUST(CLASS_SIZE(size)) ; // Make sure alignment is correct for 64 bit
 
     /* Search the free list for a fit */
     if ((bp = find_fit(asize)) != NULL) {  
@@ -207,8 +452,7 @@ void *malloc(size_t size)
     }
 
     /* No fit found. Get more memory and place the block */
-    extendsize = MAX(asize,CHUNKSIZE);                 
-    if ((bp = extend_heap(extendsize/WSIZE)) == NULL)  
+    if ((bp = grow_heap(asize)) == NULL)  
         return NULL;                                  
     place(bp, asize); 
 
@@ -229,6 +473,8 @@ void free(void *bp){
     if (heap_listp == 0){
         mm_init();
     }
+    CHECK_CALL() ;
+    CHECK_ALLOCATED(bp) ;
 
     PUT(HDRP(bp), PACK(size, 0));
     PUT(FTRP(bp), PACK(size, 0));
@@ -250,12 +496,7 @@ void *realloc(void *ptr, size_t size)
     size_t asize ;
 
     /* Adjust block size to include overhead and alignment reqs. */
-    if (size <= DSIZE)                                          
-        asize = 2*DSIZE;                                        
-    else
-        asize = DSIZE * ((size + (DSIZE) + (DSIZE-1)) / DSIZE); 
-        
-    asize = MAX(asize, MIN) ;
+    asize = ADJUST(CLASS_SIZE(size)) ;
 
     /* Case 1: If size == 0 then this is just free, and we return NULL. */
     if(size == 0) {
@@ -268,6 +509,7 @@ void *realloc(void *ptr, size_t size)
         return malloc(size);
     }
 
+    CHECK_ALLOCATED(ptr) ;
     oldsize = GET_SIZE(HDRP(ptr));
 
     /* Case 3: if old size and new size are the same */
@@ -298,15 +540,265 @@ void *realloc(void *ptr, size_t size)
  */
 void *calloc (size_t nmemb, size_t size)
 {
-  size_t bytes = nmemb * size;
+  size_t bytes;
   void *newptr;
 
+  if (__builtin_mul_overflow(nmemb, size, &bytes)) {
+    errno = ENOMEM;
+    return NULL;
+  }
+
   newptr = malloc(bytes);
-  memset(newptr, 0, bytes);
+  if (newptr != NULL)
+    memset(newptr, 0, bytes);
 
   return newptr;
 }
 
+/*
+ * Malloc_usable_size - Number of payload bytes in the block at ptr, which
+ * is at least what was asked for.
+ */
+size_t malloc_usable_size(void *ptr)
+{
+    if (ptr == NULL)
+        return 0;
+    return GET_SIZE(HDRP(ptr)) - DSIZE;
+}
+
+/*
+ * Memalign - Allocate a block whose payload is aligned to alignment bytes,
+ * which must be a power of two. 
+ * We look for a free block big enough to hold the payload at any
+ * alignment plus a minimum sized block in front of it. The leading slack
+ * is split off as a free block of its own instead of being wasted, and
+ * place splits off the tail as usual.
+ */
+void *memalign(size_t alignment, size_t size)
+{
+    size_t asize;      /* Adjusted block size */
+    size_t search;     /* Free block size that is sure to fit */
+    size_t csize;
+    size_t lead;
+    char *bp;
+    char *p;
+
+    if (alignment & (alignment - 1)) {
+        errno = EINVAL;
+        return NULL;
+    }
+    /* ADJUST and the search size below must not wrap around */
+    if (size > SIZE_MAX - alignment - MIN - DSIZE) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    if (alignment <= ALIGNMENT)
+        return malloc(size);
+
+    if (heap_listp == 0){
+        mm_init();
+    }
+    CHECK_CALL() ;
+    if (size == 0)
+        return NULL;
+
+    asize = ADJUST(size) ;
+    search = asize + alignment + MIN ;
+
+    if ((bp = find_fit(search)) == NULL) {
+        if ((bp = grow_heap(search)) == NULL)
+            return NULL;
+    }
+
+    /* First aligned payload that leaves either nothing or a whole block
+     * in front of it */
+    p = (char *)(((size_t)bp + alignment - 1) & ~(alignment - 1));
+    while (p != bp && (size_t)(p - bp) < MIN)
+        p += alignment;
+    lead = p - bp;
+
+    if (lead > 0) {
+        csize = GET_SIZE(HDRP(bp));
+        remove_block(bp);
+        PUT(HDRP(bp), PACK(lead, 0));
+        PUT(FTRP(bp), PACK(lead, 0));
+        insert_free_block(bp);   // Its left neighbor is already allocated
+        counts.splits++;
+        PUT(HDRP(p), PACK(csize - lead, 0));
+        PUT(FTRP(p), PACK(csize - lead, 0));
+        insert_free_block(p);
+    }
+    place(p, asize);
+
+    return p;
+}
+
+/*
+ * Posix_memalign - POSIX flavor of memalign. Alignment must also be a
+ * nonzero multiple of sizeof(void *).
+ */
+int posix_memalign(void **memptr, size_t alignment, size_t size)
+{
+    void *p;
+
+    if (alignment == 0 || alignment % sizeof(void *) ||
+        (alignment & (alignment - 1)))
+        return EINVAL;
+    if ((p = memalign(alignment, size)) == NULL && size != 0)
+        return ENOMEM;
+    *memptr = p;
+    return 0;
+}
+
+/*
+ * Aligned_alloc - C11 flavor of memalign
+ */
+void *aligned_alloc(size_t alignment, size_t size)
+{
+    return memalign(alignment, size);
+}
+
+/*
+ * Malloc_batch - Allocate n blocks of size bytes each and store them in
+ * ptrs. Returns the number of blocks allocated, which is less than n only
+ * if we ran out of memory.
+ * Instead of n searches and splits we find (or make) one free block big
+ * enough for all of them, carve it into n blocks back to back and split
+ * off whatever is left once.
+ */
+size_t malloc_batch(size_t size, size_t n, void **ptrs)
+{
+    size_t asize;      /* Adjusted block size */
+    size_t total;      /* Size of the whole run */
+    size_t csize;
+    size_t k;
+    char *bp;
+
+    if (heap_listp == 0){
+        mm_init();
+    }
+    CHECK_CALL() ;
+    if (size == 0 || n == 0)
+        return 0;
+
+    /* No run of n blocks this big fits in the address space */
+    if (size > SIZE_MAX - MIN - DSIZE ||
+        __builtin_mul_overflow(ADJUST(CLASS_SIZE(size)), n, &total)) {
+        errno = ENOMEM;
+        return 0;
+    }
+    asize = ADJUST(CLASS_SIZE(size)) ;
+
+    if ((bp = find_fit(total)) == NULL &&
+        (bp = grow_heap(total)) == NULL) {
+        /* No room for one run: fall back to one block at a time */
+        for (k = 0; k < n; k++)
+            if ((ptrs[k] = malloc(size)) == NULL)
+                break;
+        return k;
+    }
+
+    csize = GET_SIZE(HDRP(bp));
+    remove_block(bp) ;
+
+    // The last block absorbs a remainder too small to stand on its own
+    if (csize - total < MIN)
+        total = csize ;
+
+    for (k = 0; k < n; k++) {
+        size_t bsize = (k == n - 1) ? total - (n - 1) * asize : asize ;
+        PUT(HDRP(bp), PACK(bsize, 1));
+        PUT(FTRP(bp), PACK(bsize, 1));
+        ptrs[k] = bp ;
+        bp = NEXT_BLKP(bp);
+    }
+
+    if (csize > total) {
+        PUT(HDRP(bp), PACK(csize - total, 0));
+        PUT(FTRP(bp), PACK(csize - total, 0));
+        insert_free_block(bp) ;  // Its right neighbor is already allocated
+        counts.splits++;
+    }
+
+    return n;
+}
+
+/*
+ * Sort_ptrs - Sort ptrs[0..n-1] by address. A heapsort, since free_batch
+ * must not call back into malloc (qsort may) and this is in place.
+ */
+static void sort_ptrs(void **ptrs, size_t n)
+{
+    size_t start, end, root, child;
+    void *tmp;
+
+    for (start = n / 2; start-- > 0; ) {
+        for (root = start; (child = 2 * root + 1) < n; root = child) {
+            if (child + 1 < n && ptrs[child] < ptrs[child + 1])
+                child++;
+            if (ptrs[root] >= ptrs[child])
+                break;
+            tmp = ptrs[root]; ptrs[root] = ptrs[child]; ptrs[child] = tmp;
+        }
+    }
+    for (end = n; end-- > 1; ) {
+        tmp = ptrs[0]; ptrs[0] = ptrs[end]; ptrs[end] = tmp;
+        for (root = 0; (child = 2 * root + 1) < end; root = child) {
+            if (child + 1 < end && ptrs[child] < ptrs[child + 1])
+                child++;
+            if (ptrs[root] >= ptrs[child])
+                break;
+            tmp = ptrs[root]; ptrs[root] = ptrs[child]; ptrs[child] = tmp;
+        }
+    }
+}
+
+/*
+ * Free_batch - Free the n blocks in ptrs (NULLs are ignored). ptrs is
+ * sorted by address in the process.
+ * Runs of blocks in the batch that are next to each other in the heap are
+ * merged up front, so each run is coalesced with its neighbors and
+ * inserted into the free list once rather than once per block.
+ */
+void free_batch(void **ptrs, size_t n)
+{
+    size_t i, j;
+    size_t size;
+    char *bp;
+
+    if (heap_listp == 0){
+        mm_init();
+    }
+    CHECK_CALL() ;
+
+    for (i = 1; i < n && ptrs[i - 1] <= ptrs[i]; i++)
+        ;
+    if (i < n)
+        sort_ptrs(ptrs, n);
+
+    for (i = 0; i < n; i = j) {
+        bp = ptrs[i];
+        j = i + 1;
+        if (bp == NULL)
+            continue;
+
+        CHECK_ALLOCATED(bp) ;
+        size = GET_SIZE(HDRP(bp));
+        while (j < n && (char *)ptrs[j] == bp + size) {
+            CHECK_ALLOCATED(ptrs[j]) ;
+            FORGET_BLOCK(ptrs[j], bp) ;
+            size += GET_SIZE(HDRP(ptrs[j]));
+            counts.coalesces++;
+            j++;
+        }
+
+        PUT(HDRP(bp), PACK(size, 0));
+        PUT(FTRP(bp), PACK(size, 0));
+        bp = coalesce(bp);
+        insert_free_block(bp) ;
+    }
+}
+
 /*
  * Coalesce - Join two adjacent free blocks and return a pointer to the 
  * coalesced block
@@ -315,7 +807,7 @@ void *calloc (size_t nmemb, size_t size)
  
 static void *coalesce(void *bp) 
 {
-    if(free_p != NULL) {
+    if(HAVE_FREE_BLOCKS) {
         size_t prev_alloc ;
         size_t next_alloc ;
         
@@ -327,17 +819,21 @@ static void *coalesce(void *bp)
         //Case 1: Left block is free
         if(!prev_alloc && next_alloc) {
             size += GET_SIZE(HDRP(PREV_BLKP(bp)));
+            FORGET_BLOCK(bp, PREV_BLKP(bp));
             bp = PREV_BLKP(bp);
             remove_block(bp);
             PUT(HDRP(bp), PACK(size, 0));
             PUT(FTRP(bp), PACK(size, 0));
+            counts.coalesces++;
         }
         //Case 2: Right block is free
         else if(prev_alloc && !next_alloc) {
             size += GET_SIZE(HDRP(NEXT_BLKP(bp)));
+            FORGET_BLOCK(NEXT_BLKP(bp), bp);
             remove_block(NEXT_BLKP(bp));
             PUT(HDRP(bp), PACK(size, 0));
             PUT(FTRP(bp), PACK(size, 0));
+            counts.coalesces++;
         }
         //Case 3: Both right and left blocks are free
         else if(!prev_alloc && !next_alloc) {
@@ -345,9 +841,12 @@ static void *coalesce(void *bp)
                 GET_SIZE(HDRP(NEXT_BLKP(bp)));
             remove_block(PREV_BLKP(bp));
             remove_block(NEXT_BLKP(bp));
+            FORGET_BLOCK(bp, PREV_BLKP(bp));
+            FORGET_BLOCK(NEXT_BLKP(bp), PREV_BLKP(bp));
             bp = PREV_BLKP(bp);
             PUT(HDRP(bp), PACK(size, 0));
             PUT(FTRP(bp), PACK(size, 0));
+            counts.coalesces += 2;
         }
 
     }
@@ -366,12 +865,13 @@ static void place(void *bp, size_t asize)
     size_t csize = GET_SIZE(HDRP(bp));   
     asize = asize ;
         
-    //If we can split the block we need to make sure we remove the extra block
-    // And re-add it to the free block list    
+    //If we can split the block we need to re-add the extra block
+    // to the free block list    
+    remove_block(bp) ;
     if ((csize - asize) >= MIN) { 
         PUT(HDRP(bp), PACK(asize, 1));
         PUT(FTRP(bp), PACK(asize, 1));
-        remove_block(bp) ; 
+        counts.splits++;
         bp = NEXT_BLKP(bp);
         PUT(HDRP(bp), PACK(csize-asize, 0));
         PUT(FTRP(bp), PACK(csize-asize, 0));
@@ -381,165 +881,487 @@ static void place(void *bp, size_t asize)
     else { 
         PUT(HDRP(bp), PACK(csize, 1));
         PUT(FTRP(bp), PACK(csize, 1));
-        remove_block(bp) ;
     }
 }
 
+#ifdef MM_SIDE_META
+/* 
+ * Find_fit - Find a fit for a block with asize bytes 
+ * With the out-of-band index we scan the size arrays group by group,
+ * prefetching a couple of groups ahead, and only dereference the block
+ * pointer of the first entry that fits
+ */
+static void *find_fit(size_t asize)
+{
+    size_t i, j, n;
+    side_group_t *grp;
+
+    counts.fits++;
+    for(i = 0 ; i < side_count ; i += SIDE_GROUP) {
+        grp = SIDE_ENTRY(i) ;
+        __builtin_prefetch(grp + 2) ;
+        n = side_count - i < SIDE_GROUP ? side_count - i : SIDE_GROUP ;
+        for(j = 0 ; j < n ; j++) {
+            if(asize <= grp->size[j]) {
+                counts.probes += i + j + 1;
+                return grp->bp[j] ;
+            }
+        }
+    }
+
+    counts.probes += side_count;
+    return NULL; /* No fit */
+}
+
+/* 
+ * Insert_free_block - Function for the out-of-band index. 
+ * Appends a free block to the index, growing the side heap by one group
+ * when the last group is full. 
+ */
+static void insert_free_block(void *ptr) {
+    size_t i = side_count++ ;
+    side_group_t *grp ;
+
+    count_free(ptr, 1) ;
+    SET_CANARY(ptr) ;
+
+    if(i == side_cap) {
+        if(mem_side_sbrk(sizeof(side_group_t)) == (void *)-1) {
+            printf("Out of side heap for the free block index\n") ;
+            exit(0) ;
+        }
+        side_cap += SIDE_GROUP ;
+    }
+
+    grp = SIDE_ENTRY(i) ;
+    grp->size[i % SIDE_GROUP] = GET_SIZE(HDRP(ptr)) ;
+    grp->bp[i % SIDE_GROUP] = ptr ;
+    SIDE_SLOT(ptr) = i ;
+}
+
+/* 
+ * Remove_block - Function for the out-of-band index. 
+ * Remove a block from the index by moving the last entry into its slot.
+ */
+static void remove_block(void *bp)
+{
+    size_t i = SIDE_SLOT(bp) ;
+    size_t last = --side_count ;
+    side_group_t *dst = SIDE_ENTRY(i) ;
+    side_group_t *src = SIDE_ENTRY(last) ;
+
+    CHECK_FREE(bp) ;
+    count_free(bp, -1) ;
+
+    dst->size[i % SIDE_GROUP] = src->size[last % SIDE_GROUP] ;
+    dst->bp[i % SIDE_GROUP] = src->bp[last % SIDE_GROUP] ;
+    SIDE_SLOT(dst->bp[i % SIDE_GROUP]) = i ;
+}
+
+#else /* !MM_SIDE_META */
+
+/*
+ * List_of - The free list for a block of size bytes
+ */
+static int list_of(size_t size)
+{
+    size_t payload = size - DSIZE ;  /* Largest request the block holds */
+    int c ;
+
+    if(payload < MM_CLASS_MAX) {
+        c = mm_class_of[(payload - 1) / MM_CLASS_GRAIN] ;
+        if(mm_class_size[c] > payload && c > 0)
+            c-- ;
+        return c ;
+    }
+    c = MM_CLASSES - 1 + (63 - __builtin_clzll(size)) -
+        (63 - __builtin_clzll(ADJUST(MM_CLASS_MAX))) ;
+    return c < NUM_LISTS ? c : NUM_LISTS - 1 ;
+}
+
 /* 
  * Find_fit - Find a fit for a block with asize bytes 
- * In the case of the explicit list implementation, we only search through 
- * the free list with pointer free_p until we find a block big enough to fit
- * asize
+ * In the case of the explicit list implementation, we search the free list
+ * for asize first fit, then take the first block of the first non-empty
+ * list after it, which is sure to fit. In address order the wilderness
+ * block is only taken if nothing else fits.
  */
 static void *find_fit(size_t asize)
 {
     void *bp;
+    int i;
+#ifdef MM_ADDR_ORDER
+    void *tail = NULL;
+#endif
 
-    //Iterate through free list until you hit NULL
-    for(bp = free_p ; bp != NULL ; bp = NEXT_FREE_BLOCK(bp)) {
-        size_t block_size = (size_t) GET_SIZE(HDRP(bp)) ;
-        if(asize <= block_size) {
-            return bp ;
+    counts.fits++;
+    for(i = list_of(asize) ; i < NUM_LISTS ; i++) {
+        for(bp = free_lists[i] ; bp != NULL ; bp = NEXT_FREE_BLOCK(bp)) {
+            size_t block_size = (size_t) GET_SIZE(HDRP(bp)) ;
+            counts.probes++;
+            if(asize <= block_size) {
+#ifdef MM_ADDR_ORDER
+                if(IS_WILDERNESS(bp)) {
+                    tail = bp ;
+                    continue ;
+                }
+#endif
+                return bp ;
+            }
         }
     }
 
+#ifdef MM_ADDR_ORDER
+    return tail;
+#else
     return NULL; /* No fit */
+#endif
 }
 
 /* 
  * Insert_free_block - Function for the explicit list implementation. 
- * Inserts a free block at the beginning of the free block list as pointed 
- * to by free_p. 
+ * Inserts a free block at the beginning of the free list for its size,
+ * or in address order at its place in it.
  */
 static void insert_free_block(void *ptr) {
-    if(free_p == NULL) { //If the free block list is empty
-        free_p = ptr ;
-        NEXT_FREE_BLOCK(ptr) = NULL ;
-        PREV_FREE_BLOCK(ptr) = NULL ;
+    int i = list_of(GET_SIZE(HDRP(ptr))) ;
+    char *prev = NULL ;
+    char *next = free_lists[i] ;
+
+    count_free(ptr, 1) ;
+    SET_CANARY(ptr) ;
+#ifdef MM_ADDR_ORDER
+    // Start from the finger, and walk forward or back to our place
+    if(list_finger[i] != NULL) {
+        if(list_finger[i] < (char *)ptr) {
+            prev = list_finger[i] ;
+            next = NEXT_FREE_BLOCK(prev) ;
+        }
+        else {
+            next = list_finger[i] ;
+            prev = PREV_FREE_BLOCK(next) ;
+        }
+    }
+    while(next != NULL && next < (char *)ptr) {
+        prev = next ;
+        next = NEXT_FREE_BLOCK(next) ;
+    }
+    while(prev != NULL && prev > (char *)ptr) {
+        next = prev ;
+        prev = PREV_FREE_BLOCK(prev) ;
+    }
+    list_finger[i] = ptr ;
+#endif
+    PREV_FREE_BLOCK(ptr) = prev ;
+    NEXT_FREE_BLOCK(ptr) = next ;
+    if(prev != NULL) {
+        NEXT_FREE_BLOCK(prev) = ptr ;
+    }
+    else {
+        free_lists[i] = ptr ;
     }
-    else { //If the free block list is non-empty
-        PREV_FREE_BLOCK(free_p) = ptr ;
-        PREV_FREE_BLOCK(ptr) = NULL ;
-        NEXT_FREE_BLOCK(ptr) = free_p ;
-        free_p = ptr ;
+    if(next != NULL) {
+        PREV_FREE_BLOCK(next) = ptr ;
     }
 }
 
 /* 
  * Remove_block - Function for the explicit list implementation. 
- * Remove a block that has been malloced from the free block list. 
- * This function is a little tricky in that we need to check whether the 
- * block to remove is at the beginning or end of list 
+ * Remove a block from its free list, before its size changes.
  */
 static void remove_block(void *bp)
 {
-    // Case 1: Block to remove is in the middle of free list
-    if (PREV_FREE_BLOCK(bp) != NULL && NEXT_FREE_BLOCK(bp) != NULL) {
-        NEXT_FREE_BLOCK(PREV_FREE_BLOCK(bp)) = NEXT_FREE_BLOCK(bp);
-        PREV_FREE_BLOCK(NEXT_FREE_BLOCK(bp)) = PREV_FREE_BLOCK(bp);
-
+    int i = list_of(GET_SIZE(HDRP(bp))) ;
+
+    CHECK_FREE(bp) ;
+    count_free(bp, -1) ;
+#ifdef MM_ADDR_ORDER
+    if(list_finger[i] == bp) {
+        list_finger[i] = PREV_FREE_BLOCK(bp) != NULL ?
+            PREV_FREE_BLOCK(bp) : NEXT_FREE_BLOCK(bp) ;
     }
-    // Case 2: Block to remove is at the end of the free list
-    else if (PREV_FREE_BLOCK(bp) != NULL && NEXT_FREE_BLOCK(bp) == NULL) {
+#endif
+    if(PREV_FREE_BLOCK(bp) != NULL) {
         NEXT_FREE_BLOCK(PREV_FREE_BLOCK(bp)) = NEXT_FREE_BLOCK(bp);
     }
-    // Case 3: Block to remove is the first block and the last one. 
-    // Free list is size 1
-    else if (PREV_FREE_BLOCK(bp) == NULL && NEXT_FREE_BLOCK(bp) == NULL){
-        free_p = NEXT_FREE_BLOCK(bp);
+    else { // Block to remove is the first block in its list
+        free_lists[i] = NEXT_FREE_BLOCK(bp);
     }
-    // Case 4: Block to remove is the first block in the free list
-    else if(PREV_FREE_BLOCK(bp) == NULL && NEXT_FREE_BLOCK(bp) != NULL) {
-        PREV_FREE_BLOCK(NEXT_FREE_BLOCK(bp)) = NULL ;
-        free_p = NEXT_FREE_BLOCK(bp);
+    if(NEXT_FREE_BLOCK(bp) != NULL) {
+        PREV_FREE_BLOCK(NEXT_FREE_BLOCK(bp)) = PREV_FREE_BLOCK(bp);
     }
 }
 
+#endif /* MM_SIDE_META */
+
 /*
- * mm_checkheap - Function to check the consistency of the heap
+ * Count_free - Add (delta 1) or take away (delta -1) free block bp in the
+ * counters for mm_stats, as it enters or leaves the free blocks
  */
-void mm_checkheap(int lineno){
-    /*Get gcc to be quiet. */
-    lineno = lineno;
+static void count_free(void *bp, int delta)
+{
+    size_t size = GET_SIZE(HDRP(bp)) ;
 
-    //1. Check that beginning of heap is correct
-    if(!((mem_heap_lo()+DSIZE) == heap_listp)) {
-        printf("Heap start is NOT correct\n") ;
-        exit(0) ;
+    counts.free_bytes += delta * (long)size ;
+    counts.free_blocks += delta ;
+    counts.class_blocks[CLASS_OF(size)] += delta ;
+}
+
+/*
+ * Mm_stats - Copy the allocator's counters to st. Everything but the
+ * heap and in-use sizes is kept as we go, so this is cheap.
+ */
+void mm_stats(mm_stats_t *st)
+{
+    *st = counts ;
+    st->heap_bytes = mem_heapsize() ;
+    // Everything but the free blocks, the padding, prologue and epilogue
+    st->used_bytes = st->heap_bytes - counts.free_bytes - (MIN + 2*WSIZE) ;
+}
+
+/*
+ * Mm_walk - Call f on each block from the first one after the prologue up
+ * to the epilogue, whose size is 0
+ */
+void mm_walk(mm_walk_fn f, void *arg)
+{
+    char *bp ;
+
+    if (heap_listp == 0)
+        return ;
+    for(bp = NEXT_BLKP(heap_listp) ; GET_SIZE(HDRP(bp)) > 0 ;
+        bp = NEXT_BLKP(bp)) {
+        f(bp, GET_SIZE(HDRP(bp)), GET_ALLOC(HDRP(bp)), arg) ;
     }
+}
 
-    //2. Check the prologue block is correct
-    int prologue_header_size = GET_SIZE(HDRP(heap_listp)) ;
-    int prologue_footer_size = GET_SIZE(FTRP(heap_listp)) ;
-    int prologue_header_alloc = GET_ALLOC(HDRP(heap_listp)) ;
-    int prologue_footer_alloc = GET_ALLOC(FTRP(heap_listp)) ;
+/*
+ * Check_fail - Report a broken heap invariant and stop
+ */
+static void check_fail(int lineno, const char *msg, void *bp)
+{
+    printf("Heap check failed (mm.c line %d): %s, block %p\n",
+           lineno, msg, bp) ;
+    exit(1) ;
+}
+
+/*
+ * Check_block - The invariants of any one block: it lies in the heap, its
+ * payload is aligned, its size is sane and its header matches its footer.
+ * The size is checked before the footer is read through it.
+ */
+static void check_block(void *bp, int lineno)
+{
+    char *p = bp ;
+    size_t size ;
 
-    if(prologue_header_size != MIN && prologue_footer_size != MIN) {
-        printf("Prologue size is NOT correct\n") ;
-        exit(0) ;
+    if(p <= heap_listp || p > (char *)mem_heap_hi()) {
+        check_fail(lineno, "Block is out of bounds", bp) ;
+    }
+    if((size_t)p % ALIGNMENT) {
+        check_fail(lineno, "Block is not aligned", bp) ;
     }
-    if(prologue_header_alloc != 1 && prologue_footer_alloc != 1) {
-        printf("Prologue alloc NOT set correctly\n") ;
-        exit(0) ;
+    size = GET_SIZE(HDRP(p)) ;
+    if(size < MIN || size != ALIGN(size) ||
+       p + size > (char *)mem_heap_hi() + 1) {
+        check_fail(lineno, "Block size is corrupt", bp) ;
     }
+    if(GET(HDRP(p)) != GET(FTRP(p))) {
+        check_fail(lineno, "Header and footer for a block do not match", bp) ;
+    }
+}
 
-    //3. Check epilogue block is correct
-    size_t test = mem_heapsize() ;
-    void *epilogue_block = mem_heap_lo() + (test - WSIZE);
+#if MM_CHECK >= 1
+/*
+ * Check_allocated - Local check of a block handed back to us by the
+ * program, which must be one we allocated
+ */
+static void check_allocated(void *bp, int lineno)
+{
+    check_block(bp, lineno) ;
+    if(!GET_ALLOC(HDRP(bp))) {
+        check_fail(lineno, "Block is already free (double free?)", bp) ;
+    }
+}
 
-    int epilogue_size = GET_SIZE(epilogue_block) ;
-    int epilogue_alloc = GET_ALLOC(epilogue_block) ;
-    if(epilogue_size != 0) {
-        printf("Epilogue size is NOT correct\n") ;
-        exit(0) ;
+/*
+ * Check_free - Local check of a free block about to be reused: nothing
+ * may have written to it since it was freed
+ */
+static void check_free(void *bp, int lineno)
+{
+    check_block(bp, lineno) ;
+    if(GET_ALLOC(HDRP(bp))) {
+        check_fail(lineno, "Allocated block in the free blocks", bp) ;
+    }
+    if(GET_SIZE(HDRP(bp)) >= CANARY_ROOM && *CANARYP(bp) != CANARY(bp)) {
+        check_fail(lineno, "Free block was written to (use after free?)", bp) ;
+    }
+#ifndef MM_SIDE_META
+    if(PREV_FREE_BLOCK(bp) ? NEXT_FREE_BLOCK(PREV_FREE_BLOCK(bp)) != bp
+                           : free_lists[list_of(GET_SIZE(HDRP(bp)))] != bp) {
+        check_fail(lineno, "Corrupt prev pointer in free list", bp) ;
     }
-    if(epilogue_alloc != 1) {
-        printf("Epilogue alloc is NOT set correctly\n") ;
-        exit(0) ;
+    if(NEXT_FREE_BLOCK(bp) && PREV_FREE_BLOCK(NEXT_FREE_BLOCK(bp)) != bp) {
+        check_fail(lineno, "Corrupt next pointer in free list", bp) ;
     }
+#endif
+}
 
-    //4. Check the free block list
-    if(free_p != NULL) {
-        if(PREV_FREE_BLOCK(free_p) != NULL) {
-            printf("Start of free block list is corrupt\n") ;
-            exit(0) ;
+/*
+ * Check_signal - SIGUSR1 handler: have the next call check everything
+ */
+static void check_signal(int sig)
+{
+    (void)sig ;
+    check_requested = 1 ;
+}
+
+#if MM_CHECK >= 2
+/*
+ * Check_window - Check the next CHECK_WINDOW blocks from check_cursor on,
+ * going back to the first block after the last, and leave the cursor at
+ * the block after them. Merges move the cursor off blocks that stop
+ * existing (FORGET_BLOCK), so it always points at a block or the
+ * epilogue.
+ */
+static void check_window(int lineno)
+{
+    char *bp = check_cursor ;
+    int n ;
+
+    for(n = 0 ; n < CHECK_WINDOW ; n++, bp = NEXT_BLKP(bp)) {
+        if(GET_SIZE(HDRP(bp)) == 0) {
+            bp = NEXT_BLKP(heap_listp) ;
+        }
+        check_block(bp, lineno) ;
+        if(!GET_ALLOC(HDRP(bp))) {
+            if(!GET_ALLOC(HDRP(NEXT_BLKP(bp)))) {
+                check_fail(lineno, "Two free blocks next to each other", bp) ;
+            }
+            if(GET_SIZE(HDRP(bp)) >= CANARY_ROOM &&
+               *CANARYP(bp) != CANARY(bp)) {
+                check_fail(lineno, "Free block was written to (use after free?)",
+                           bp) ;
+            }
         }
     }
+    check_cursor = bp ;
+}
+#endif
+
+/*
+ * Check_call - Checks made on entry to each call, by level
+ */
+static void check_call(int lineno)
+{
+    check_calls++ ;
+    if(check_requested || MM_CHECK >= 3) {
+        check_requested = 0 ;
+        mm_checkheap(lineno) ;
+        return ;
+    }
+#if MM_CHECK >= 2
+    if(check_calls % CHECK_PERIOD == 0) {
+        check_window(lineno) ;
+    }
+#endif
+}
+#endif /* MM_CHECK >= 1 */
 
+/*
+ * mm_checkheap - Check the consistency of the whole heap: the prologue
+ * and epilogue, every block in address order, and the free blocks, which
+ * must be exactly the blocks marked free. lineno is reported on failure.
+ */
+void mm_checkheap(int lineno){
     void *bp ;
-    for(bp = free_p ; bp != NULL ; bp = NEXT_FREE_BLOCK(bp)) {
-        if(NEXT_FREE_BLOCK(bp) != NULL) {
-            if(bp != PREV_FREE_BLOCK(NEXT_FREE_BLOCK(bp))) {
-                printf("Corrupt prev and next pointers in free list\n") ;
-                exit(0) ;
-            }
-        }
+    size_t nfree = 0 ;
 
-        if(bp < mem_heap_lo() || bp > mem_heap_hi()) {
-            printf("A free block is out of bounds\n") ;
-            exit(0) ;
-        }
+    //1. Check that beginning of heap is correct
+    if(!((mem_heap_lo()+DSIZE) == heap_listp)) {
+        check_fail(lineno, "Heap start is NOT correct", heap_listp) ;
     }
 
-    //5. Check all the blocks
-    for(bp = mem_heap_lo() + WSIZE ; (bp - (WSIZE - 1)) > mem_heap_hi() ; 
+    //2. Check the prologue block is correct
+    if(GET_SIZE(HDRP(heap_listp)) != MIN || GET_SIZE(FTRP(heap_listp)) != MIN ||
+       !GET_ALLOC(HDRP(heap_listp)) || !GET_ALLOC(FTRP(heap_listp))) {
+        check_fail(lineno, "Prologue is NOT correct", heap_listp) ;
+    }
+
+    //3. Check all the blocks, which must end at the epilogue
+    for(bp = NEXT_BLKP(heap_listp) ; GET_SIZE(HDRP(bp)) > 0 ;
         bp = NEXT_BLKP(bp)) {
-        if(GET_SIZE(HDRP(bp)) != GET_SIZE(FTRP(bp))) {
-            printf("Header and footer size for a block do not match\n") ;
-            exit(0) ;
+        check_block(bp, lineno) ;
+        if(!GET_ALLOC(HDRP(bp))) {
+            nfree++ ;
+            if(!GET_ALLOC(HDRP(NEXT_BLKP(bp)))) {
+                check_fail(lineno, "Two free blocks next to each other", bp) ;
+            }
+#if MM_CHECK >= 1
+            if(GET_SIZE(HDRP(bp)) >= CANARY_ROOM &&
+               *CANARYP(bp) != CANARY(bp)) {
+                check_fail(lineno, "Free block was written to (use after free?)",
+                           bp) ;
+            }
+#endif
         }
+    }
+    if((char *)HDRP(bp) != (char *)mem_heap_hi() + 1 - WSIZE ||
+       !GET_ALLOC(HDRP(bp))) {
+        check_fail(lineno, "Epilogue is NOT correct", bp) ;
+    }
 
-        if(GET_ALLOC(HDRP(bp)) != GET_ALLOC(FTRP(bp))) {
-            printf("Allocation for header/footer for a block do not match\n") ;
-            exit(0) ;
+#ifdef MM_SIDE_META
+    //4. Check the free block index
+    size_t i ;
+    for(i = 0 ; i < side_count ; i++) {
+        bp = SIDE_ENTRY(i)->bp[i % SIDE_GROUP] ;
+        check_block(bp, lineno) ;
+
+        if(SIDE_SLOT(bp) != i || GET_ALLOC(HDRP(bp)) ||
+           SIDE_ENTRY(i)->size[i % SIDE_GROUP] != GET_SIZE(HDRP(bp))) {
+            check_fail(lineno, "Free block index entry does not match its block",
+                       bp) ;
         }
-
-        int size = GET_SIZE(HDRP(bp)) ;
-        if(size != ALIGN(size)) {
-            printf("Size is not aligned for a block\n") ;
-            exit(0) ;
+    }
+    if(side_count != nfree) {
+        check_fail(lineno, "Free block index misses free blocks", NULL) ;
+    }
+#else
+    //4. Check the free block lists, stopping if they are longer than they
+    //   can be
+    size_t n = 0 ;
+    int i ;
+    for(i = 0 ; i < NUM_LISTS ; i++) {
+        bp = free_lists[i] ;
+        if(bp != NULL && PREV_FREE_BLOCK(bp) != NULL) {
+            check_fail(lineno, "Start of free block list is corrupt", bp) ;
+        }
+        for( ; bp != NULL && n <= nfree ; bp = NEXT_FREE_BLOCK(bp), n++) {
+            check_block(bp, lineno) ;
+            if(GET_ALLOC(HDRP(bp))) {
+                check_fail(lineno, "Allocated block in the free list", bp) ;
+            }
+            if(list_of(GET_SIZE(HDRP(bp))) != i) {
+                check_fail(lineno, "Free block is in the wrong list", bp) ;
+            }
+#ifdef MM_ADDR_ORDER
+            if(NEXT_FREE_BLOCK(bp) != NULL && NEXT_FREE_BLOCK(bp) < bp) {
+                check_fail(lineno, "Free list is out of address order", bp) ;
+            }
+#endif
+            if(NEXT_FREE_BLOCK(bp) != NULL &&
+               bp != PREV_FREE_BLOCK(NEXT_FREE_BLOCK(bp))) {
+                check_fail(lineno, "Corrupt prev and next pointers in free list",
+                           bp) ;
+            }
         }
     }
+    if(n != nfree) {
+        check_fail(lineno, "Free list does not hold every free block", NULL) ;
+    }
+#endif
 }
 
 
@@ -551,8 +1373,8 @@ void mm_checkheap(int lineno){
     static void print_block(void *ptr) {
     int header_alloc = GET_ALLOC(HDRP(ptr)) ;
     int footer_alloc = GET_ALLOC(FTRP(ptr)) ;
-    int header_size = GET_SIZE(HDRP(ptr)) ;
-    int footer_size = GET_SIZE(FTRP(ptr)) ;
+    size_t header_size = GET_SIZE(HDRP(ptr)) ;
+    size_t footer_size = GET_SIZE(FTRP(ptr)) ;
 
     // If allocated but header size is 0, then a tail block
     if(header_alloc && (header_size == 0)) {
@@ -562,11 +1384,11 @@ void mm_checkheap(int lineno){
 
     // if both header and footer allocatios set to 1, then allocated block
     if(header_alloc && footer_alloc) {
-        printf("Allocated block %p -- Header: %d #### Footer: %d\n", 
+        printf("Allocated block %p -- Header: %zu #### Footer: %zu\n", 
             ptr, header_size, footer_size) ;
     }
     else {
-        printf("Free block %p -- Header: %d #### Footer: %d", 
+        printf("Free block %p -- Header: %zu #### Footer: %zu", 
             ptr, header_size, footer_size) ; 
         printf("-- Prev pointer: %p #### Next pointer: %p\n", 
             PREV_FREE_BLOCK(ptr), NEXT_FREE_BLOCK(ptr)) ;
@@ -7,6 +7,12 @@ extern void *mm_malloc (size_t size);
 extern void mm_free (void *ptr);
 extern void *mm_realloc(void *ptr, size_t size);
 extern void *mm_calloc (size_t nmemb, size_t size);
+extern void *mm_memalign(size_t alignment, size_t size);
+extern int mm_posix_memalign(void **memptr, size_t alignment, size_t size);
+extern void *mm_aligned_alloc(size_t alignment, size_t size);
+extern size_t mm_malloc_batch(size_t size, size_t n, void **ptrs);
+extern void mm_free_batch(void **ptrs, size_t n);
+extern size_t mm_usable_size(void *ptr);
 
 #else
 
@@ -15,10 +21,48 @@ extern void *malloc (size_t size);
 extern void free (void *ptr);
 extern void *realloc(void *ptr, size_t size);
 extern void *calloc (size_t nmemb, size_t size);
+extern void *memalign(size_t alignment, size_t size);
+extern int posix_memalign(void **memptr, size_t alignment, size_t size);
+extern void *aligned_alloc(size_t alignment, size_t size);
+extern size_t malloc_batch(size_t size, size_t n, void **ptrs);
+extern void free_batch(void **ptrs, size_t n);
+extern size_t malloc_usable_size(void *ptr);
 
 #endif
 
 extern int mm_init(void);
 
+/*
+ * Counters the allocator keeps as it runs, for mm_stats. Free blocks are
+ * counted by size class: class k holds blocks of 2^(k+4) up to
+ * 2^(k+5) - 1 bytes, and the last class everything bigger.
+ */
+#define MM_STATS_CLASSES 16
+
+typedef struct {
+    size_t heap_bytes;        /* size of the heap */
+    size_t used_bytes;        /* in allocated blocks, headers included */
+    size_t free_bytes;        /* in free blocks */
+    size_t free_blocks;       /* number of free blocks */
+    size_t class_blocks[MM_STATS_CLASSES]; /* ... by size class */
+    unsigned long fits;       /* free block searches */
+    unsigned long probes;     /* free blocks they looked at */
+    unsigned long splits;     /* free blocks split to place a request */
+    unsigned long coalesces;  /* free blocks merged with a neighbor */
+    unsigned long extends;    /* heap extensions */
+    size_t extend_bytes;      /* bytes they added */
+} mm_stats_t;
+
+extern void mm_stats(mm_stats_t *st);
+
+/*
+ * mm_walk calls f on every block of the heap in address order, with its
+ * payload address, block size (headers included) and whether it is
+ * allocated.
+ */
+typedef void (*mm_walk_fn)(void *bp, size_t size, int alloc, void *arg);
+
+extern void mm_walk(mm_walk_fn f, void *arg);
+
 /* This is largely for debugging. */
 extern void mm_checkheap(int lineno);
@@ -0,0 +1,430 @@
+/*
+ * mtrace.c - Record the allocation calls of a real program
+ *
+ * Built as libmtrace.so (see the Makefile) and loaded with
+ *
+ *     LD_PRELOAD=./libmtrace.so MTRACE_FILE=prefix program args...
+ *
+ * it passes every malloc, calloc, realloc, memalign, posix_memalign,
+ * aligned_alloc and free on to the C library and logs it to
+ * prefix.<pid>.bin (mtrace.<pid>.bin by default). mtrace2rep turns the
+ * log into an mdriver trace.
+ *
+ * To keep the overhead low, each thread appends records to a buffer of
+ * its own and writes it out with a single write() when it fills up, when
+ * the thread exits and when the process exits. The only shared state on
+ * the fast path is the sequence counter, an atomic add. Frees take their
+ * sequence number before the block is released and allocations after it
+ * is obtained, so a block handed from one thread to another is always
+ * freed before it is allocated again. A realloc that moves its block
+ * does both, so it takes two numbers: one before the call, for an
+ * MTRACE_MOVE record of the release of the old block, and one after,
+ * for the MTRACE_REALLOC record of the new one.
+ *
+ * dlsym may itself allocate before we know where the real functions are;
+ * those few requests are served from a static bootstrap buffer and are
+ * neither recorded nor ever freed.
+ */
+#define _GNU_SOURCE
+#include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "mtrace.h"
+
+#define BUF_RECS  8192          /* records per thread buffer */
+#define BOOT_SIZE (64*1024)     /* bootstrap buffer for dlsym (bytes) */
+
+/* A thread's record buffer */
+typedef struct tbuf {
+    struct tbuf *next;          /* all live buffers, for the exit flush */
+    uint32_t tid;               /* thread number written to the records */
+    uint32_t n;                 /* records in use */
+    mtrace_rec_t recs[BUF_RECS];
+} tbuf_t;
+
+/* The C library's functions */
+static void *(*real_malloc)(size_t);
+static void *(*real_calloc)(size_t, size_t);
+static void *(*real_realloc)(void *, size_t);
+static void *(*real_memalign)(size_t, size_t);
+static int (*real_posix_memalign)(void **, size_t, size_t);
+static void *(*real_aligned_alloc)(size_t, size_t);
+static void (*real_free)(void *);
+
+static char boot_buf[BOOT_SIZE] __attribute__((aligned(16)));
+static size_t boot_used;
+static int initializing;
+
+static int out_fd = -1;         /* the log file */
+static uint64_t next_seq;       /* global sequence counter */
+static uint32_t next_tid;       /* thread numbers handed out so far */
+static tbuf_t *all_bufs;        /* every thread's buffer... */
+static char bufs_lock;          /* ...and a spin lock for the list */
+static pthread_key_t buf_key;   /* runs thread_exit for each buffer */
+static int done;                /* set once the process is exiting */
+
+/* initial-exec, so that reaching them never calls into the allocator */
+static __thread tbuf_t *my_buf __attribute__((tls_model("initial-exec")));
+static __thread int in_hook __attribute__((tls_model("initial-exec")));
+
+static void lock_bufs(void)
+{
+    while (__atomic_test_and_set(&bufs_lock, __ATOMIC_ACQUIRE))
+        ;
+}
+
+static void unlock_bufs(void)
+{
+    __atomic_clear(&bufs_lock, __ATOMIC_RELEASE);
+}
+
+/*
+ * open_log - Create the log file for this process and write its header
+ */
+static void open_log(void)
+{
+    char path[4096];
+    const char *prefix = getenv("MTRACE_FILE");
+    mtrace_hdr_t hdr;
+
+    snprintf(path, sizeof(path), "%s.%d.bin", prefix ? prefix : "mtrace",
+             (int)getpid());
+    out_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+    if (out_fd < 0)
+        return;
+
+    hdr.magic = MTRACE_MAGIC;
+    hdr.version = MTRACE_VERSION;
+    hdr.record_size = sizeof(mtrace_rec_t);
+    hdr.pid = getpid();
+    if (write(out_fd, &hdr, sizeof(hdr)) != sizeof(hdr)) {
+        close(out_fd);
+        out_fd = -1;
+    }
+}
+
+/*
+ * flush - Append the records in b to the log
+ */
+static void flush(tbuf_t *b)
+{
+    size_t len = b->n * sizeof(mtrace_rec_t);
+    char *p = (char *)b->recs;
+    ssize_t rc;
+
+    while (out_fd >= 0 && len > 0) {
+        if ((rc = write(out_fd, p, len)) < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        p += rc;
+        len -= rc;
+    }
+    b->n = 0;
+}
+
+/*
+ * thread_exit - Flush and release the buffer of a thread that is exiting
+ */
+static void thread_exit(void *arg)
+{
+    tbuf_t *b = arg, **bp;
+
+    in_hook = 1;
+    lock_bufs();
+    flush(b);
+    for (bp = &all_bufs; *bp != NULL; bp = &(*bp)->next)
+        if (*bp == b) {
+            *bp = b->next;
+            break;
+        }
+    unlock_bufs();
+    my_buf = NULL;
+    munmap(b, sizeof(tbuf_t));
+    in_hook = 0;
+}
+
+/*
+ * new_buf - Give the calling thread a buffer. Comes from mmap, not from
+ *     the allocator we are watching.
+ */
+static tbuf_t *new_buf(void)
+{
+    tbuf_t *b;
+
+    b = mmap(NULL, sizeof(tbuf_t), PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (b == MAP_FAILED)
+        return NULL;
+    b->n = 0;
+    b->tid = __atomic_fetch_add(&next_tid, 1, __ATOMIC_RELAXED);
+    lock_bufs();
+    b->next = all_bufs;
+    all_bufs = b;
+    unlock_bufs();
+    my_buf = b;
+    pthread_setspecific(buf_key, b);
+    return b;
+}
+
+/*
+ * Fork handler: the child starts a log of its own, without the records
+ * its parent had buffered or the buffers of the parent's other threads.
+ */
+static void fork_child(void)
+{
+    in_hook = 1;
+    all_bufs = my_buf;
+    if (my_buf != NULL) {
+        my_buf->next = NULL;
+        my_buf->n = 0;
+    }
+    bufs_lock = 0;
+    if (out_fd >= 0)
+        close(out_fd);
+    open_log();
+    in_hook = 0;
+}
+
+/*
+ * finish - Flush every buffer at exit. Threads still running at this
+ *     point lose whatever they record from now on.
+ */
+static void __attribute__((destructor)) finish(void)
+{
+    tbuf_t *b;
+
+    in_hook = 1;
+    done = 1;
+    lock_bufs();
+    for (b = all_bufs; b != NULL; b = b->next)
+        flush(b);
+    unlock_bufs();
+}
+
+static void init(void)
+{
+    if (initializing)
+        return;
+    initializing = 1;
+    in_hook = 1;     /* whatever dlsym allocates is not the program's */
+    real_malloc = dlsym(RTLD_NEXT, "malloc");
+    real_calloc = dlsym(RTLD_NEXT, "calloc");
+    real_realloc = dlsym(RTLD_NEXT, "realloc");
+    real_memalign = dlsym(RTLD_NEXT, "memalign");
+    real_posix_memalign = dlsym(RTLD_NEXT, "posix_memalign");
+    real_aligned_alloc = dlsym(RTLD_NEXT, "aligned_alloc");
+    real_free = dlsym(RTLD_NEXT, "free");
+    if (!real_malloc || !real_calloc || !real_realloc || !real_memalign ||
+        !real_posix_memalign || !real_aligned_alloc || !real_free) {
+        static const char msg[] = "libmtrace: cannot find the real malloc\n";
+        (void)!write(STDERR_FILENO, msg, sizeof(msg) - 1);
+        _exit(1);
+    }
+    open_log();
+    pthread_key_create(&buf_key, thread_exit);
+    pthread_atfork(NULL, NULL, fork_child);
+    in_hook = 0;
+    initializing = 0;
+}
+
+static void __attribute__((constructor)) mtrace_init(void)
+{
+    if (real_malloc == NULL)
+        init();
+}
+
+/*
+ * boot_alloc - Serve allocations made while dlsym is running
+ */
+static void *boot_alloc(size_t size)
+{
+    char *p;
+
+    size = (size + 15) & ~(size_t)15;
+    if (size > BOOT_SIZE - boot_used)
+        return NULL;
+    p = boot_buf + boot_used;
+    boot_used += size;
+    return p;
+}
+
+#define IS_BOOT(p) ((char *)(p) >= boot_buf && (char *)(p) < boot_buf + BOOT_SIZE)
+
+/*
+ * seq - Take the next sequence number
+ */
+static uint64_t seq(void)
+{
+    return __atomic_fetch_add(&next_seq, 1, __ATOMIC_RELAXED);
+}
+
+/*
+ * record - Log one call in the calling thread's buffer
+ */
+static void record(uint32_t op, void *ptr, uint64_t arg, size_t size,
+                   uint64_t s)
+{
+    tbuf_t *b = my_buf;
+    mtrace_rec_t *r;
+
+    if (done)
+        return;
+    if (b == NULL && (b = new_buf()) == NULL)
+        return;
+    r = &b->recs[b->n++];
+    r->seq = s;
+    r->ptr = (uintptr_t)ptr;
+    r->arg = arg;
+    r->size = size;
+    r->op = op;
+    r->tid = b->tid;
+    if (b->n == BUF_RECS)
+        flush(b);
+}
+
+void *malloc(size_t size)
+{
+    void *p;
+
+    if (real_malloc == NULL) {
+        init();
+        if (real_malloc == NULL)
+            return boot_alloc(size);
+    }
+    if (in_hook)
+        return real_malloc(size);
+
+    in_hook = 1;
+    if ((p = real_malloc(size)) != NULL)
+        record(MTRACE_MALLOC, p, 0, size, seq());
+    in_hook = 0;
+    return p;
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+    void *p;
+
+    if (real_calloc == NULL) {
+        init();
+        if (real_calloc == NULL) {
+            if (size && nmemb > SIZE_MAX / size)
+                return NULL;
+            return boot_alloc(nmemb * size);   /* static, so zeroed */
+        }
+    }
+    if (in_hook)
+        return real_calloc(nmemb, size);
+
+    in_hook = 1;
+    if ((p = real_calloc(nmemb, size)) != NULL)
+        record(MTRACE_CALLOC, p, 0, nmemb * size, seq());
+    in_hook = 0;
+    return p;
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    size_t avail;
+    uint64_t s;
+    void *p;
+
+    if (real_realloc == NULL)
+        init();
+    if (IS_BOOT(ptr)) {
+        /* bootstrap blocks cannot grow: move them to the real heap */
+        avail = boot_buf + BOOT_SIZE - (char *)ptr;
+        if ((p = malloc(size)) != NULL)
+            memcpy(p, ptr, size < avail ? size : avail);
+        return p;
+    }
+    if (in_hook)
+        return real_realloc(ptr, size);
+
+    in_hook = 1;
+    s = seq();          /* the old block may be gone once the call returns */
+    p = real_realloc(ptr, size);
+    if (size == 0) {
+        record(MTRACE_REALLOC, p, (uintptr_t)ptr, size, s);
+    } else if (p != NULL) {
+        if (ptr != NULL && p != ptr)
+            record(MTRACE_MOVE, ptr, (uintptr_t)p, size, s);
+        record(MTRACE_REALLOC, p, (uintptr_t)ptr, size, seq());
+    }
+    in_hook = 0;
+    return p;
+}
+
+void *memalign(size_t alignment, size_t size)
+{
+    void *p;
+
+    if (real_memalign == NULL)
+        init();
+    if (in_hook)
+        return real_memalign(alignment, size);
+
+    in_hook = 1;
+    if ((p = real_memalign(alignment, size)) != NULL)
+        record(MTRACE_MEMALIGN, p, alignment, size, seq());
+    in_hook = 0;
+    return p;
+}
+
+int posix_memalign(void **memptr, size_t alignment, size_t size)
+{
+    int rc;
+
+    if (real_posix_memalign == NULL)
+        init();
+    if (in_hook)
+        return real_posix_memalign(memptr, alignment, size);
+
+    in_hook = 1;
+    if ((rc = real_posix_memalign(memptr, alignment, size)) == 0)
+        record(MTRACE_MEMALIGN, *memptr, alignment, size, seq());
+    in_hook = 0;
+    return rc;
+}
+
+void *aligned_alloc(size_t alignment, size_t size)
+{
+    void *p;
+
+    if (real_aligned_alloc == NULL)
+        init();
+    if (in_hook)
+        return real_aligned_alloc(alignment, size);
+
+    in_hook = 1;
+    if ((p = real_aligned_alloc(alignment, size)) != NULL)
+        record(MTRACE_MEMALIGN, p, alignment, size, seq());
+    in_hook = 0;
+    return p;
+}
+
+void free(void *ptr)
+{
+    if (ptr == NULL || IS_BOOT(ptr))
+        return;
+    if (real_free == NULL)
+        init();
+    if (in_hook) {
+        real_free(ptr);
+        return;
+    }
+
+    in_hook = 1;
+    record(MTRACE_FREE, ptr, 0, 0, seq());
+    real_free(ptr);
+    in_hook = 0;
+}
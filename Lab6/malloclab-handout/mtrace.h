@@ -0,0 +1,38 @@
+/*
+ * mtrace.h - record format shared by the allocation recorder (mtrace.c,
+ *     built as libmtrace.so) and the converter to .rep files (mtrace2rep.c)
+ *
+ * A recording is a file header followed by raw records. Each thread
+ * appends whole buffers of records, so records from different threads
+ * are interleaved in blocks; the global sequence number restores the
+ * order in which the calls happened.
+ */
+#include <stdint.h>
+
+#define MTRACE_MAGIC   0x4352544d   /* "MTRC" */
+#define MTRACE_VERSION 2
+
+/* What a record describes */
+#define MTRACE_MALLOC   1   /* ptr = malloc(size) */
+#define MTRACE_CALLOC   2   /* ptr = calloc(size bytes in all) */
+#define MTRACE_REALLOC  3   /* ptr = realloc(arg, size) */
+#define MTRACE_MEMALIGN 4   /* ptr = memalign(arg, size) and friends */
+#define MTRACE_FREE     5   /* free(ptr) */
+#define MTRACE_MOVE     6   /* realloc(ptr, size) released ptr; the thread's
+                               MTRACE_REALLOC record of the call follows */
+
+typedef struct {
+    uint32_t magic;         /* MTRACE_MAGIC */
+    uint32_t version;       /* MTRACE_VERSION */
+    uint32_t record_size;   /* sizeof(mtrace_rec_t) */
+    uint32_t pid;           /* process that wrote the file */
+} mtrace_hdr_t;
+
+typedef struct {
+    uint64_t seq;           /* global order of the call */
+    uint64_t ptr;           /* block returned, or freed */
+    uint64_t arg;           /* old block for realloc, alignment for memalign */
+    uint64_t size;          /* bytes asked for */
+    uint32_t op;            /* MTRACE_xxx */
+    uint32_t tid;           /* small per-process thread number */
+} mtrace_rec_t;
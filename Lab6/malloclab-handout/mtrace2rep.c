@@ -0,0 +1,341 @@
+/*
+ * mtrace2rep.c - Turn a libmtrace.so recording into an mdriver trace
+ *
+ * Usage: mtrace2rep [-w <weight>] [-o <file.rep>] <mtrace.<pid>.bin>
+ *
+ * Records are put back in call order by sequence number, and every block
+ * address is mapped to a fresh block id when it is allocated, so that
+ * addresses the C library reuses become distinct ids. Calls mdriver
+ * cannot replay are adjusted:
+ *   - zero-byte requests become one-byte requests (mm_malloc(0) is NULL),
+ *   - calloc becomes a plain allocation,
+ *   - frees of blocks we never saw allocated (made before recording
+ *     started, or by functions we do not intercept) are dropped,
+ *   - a realloc of an unknown block becomes an allocation.
+ * A realloc that moved its block is recorded twice: the release of the
+ * old block (MTRACE_MOVE) takes its place in the order when the call
+ * started, and the realloc itself when it returned, so that another
+ * thread may get the old address back in between without the two
+ * blocks being confused. If threads raced so that an address comes back while it still looks
+ * live, the old block is freed first; the number of such fixes is
+ * reported.
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "mtrace.h"
+
+/* One request in the output trace */
+typedef struct {
+    char type;          /* 'a', 'r', 'm' or 'f' */
+    int id;
+    size_t size;
+    size_t align;
+} op_t;
+
+/* Open addressing map from live block address to block id */
+typedef struct {
+    uint64_t *keys;     /* 0 marks an empty slot */
+    int *ids;
+    size_t cap;         /* power of 2 */
+    size_t count;
+} map_t;
+
+static void app_error(const char *msg, const char *arg)
+{
+    fprintf(stderr, "mtrace2rep: %s%s%s\n", msg, arg ? ": " : "",
+            arg ? arg : "");
+    exit(1);
+}
+
+static void *xmalloc(size_t size)
+{
+    void *p;
+
+    if ((p = malloc(size)) == NULL)
+        app_error("out of memory", NULL);
+    return p;
+}
+
+static size_t slot(const map_t *m, uint64_t key)
+{
+    return (size_t)((key >> 4) * 0x9e3779b97f4a7c15ULL) & (m->cap - 1);
+}
+
+static void map_init(map_t *m, size_t cap)
+{
+    m->cap = cap;
+    m->count = 0;
+    m->keys = xmalloc(cap * sizeof(*m->keys));
+    m->ids = xmalloc(cap * sizeof(*m->ids));
+    memset(m->keys, 0, cap * sizeof(*m->keys));
+}
+
+/*
+ * map_find - Returns the id of key, or -1
+ */
+static int map_find(const map_t *m, uint64_t key)
+{
+    size_t i;
+
+    for (i = slot(m, key); m->keys[i] != 0; i = (i + 1) & (m->cap - 1))
+        if (m->keys[i] == key)
+            return m->ids[i];
+    return -1;
+}
+
+static void map_put(map_t *m, uint64_t key, int id);
+
+static void map_grow(map_t *m)
+{
+    map_t old = *m;
+    size_t i;
+
+    map_init(m, old.cap * 2);
+    for (i = 0; i < old.cap; i++)
+        if (old.keys[i] != 0)
+            map_put(m, old.keys[i], old.ids[i]);
+    free(old.keys);
+    free(old.ids);
+}
+
+static void map_put(map_t *m, uint64_t key, int id)
+{
+    size_t i;
+
+    if (2 * (m->count + 1) > m->cap)
+        map_grow(m);
+    for (i = slot(m, key); m->keys[i] != 0; i = (i + 1) & (m->cap - 1))
+        if (m->keys[i] == key) {
+            m->ids[i] = id;
+            return;
+        }
+    m->keys[i] = key;
+    m->ids[i] = id;
+    m->count++;
+}
+
+/*
+ * map_remove - Delete key, shifting later entries of its probe run back
+ *     so that lookups never need tombstones
+ */
+static void map_remove(map_t *m, uint64_t key)
+{
+    size_t i, j, k;
+
+    for (i = slot(m, key); m->keys[i] != key; i = (i + 1) & (m->cap - 1))
+        if (m->keys[i] == 0)
+            return;
+    m->keys[i] = 0;
+    m->count--;
+    for (j = (i + 1) & (m->cap - 1); m->keys[j] != 0;
+         j = (j + 1) & (m->cap - 1)) {
+        k = slot(m, m->keys[j]);
+        /* leave j alone if its home slot lies (cyclically) in (i, j] */
+        if (i <= j ? (i < k && k <= j) : (i < k || k <= j))
+            continue;
+        m->keys[i] = m->keys[j];
+        m->ids[i] = m->ids[j];
+        m->keys[j] = 0;
+        i = j;
+    }
+}
+
+/* Key of a thread's realloc in progress in the map of moving blocks */
+#define TID_KEY(tid) (((uint64_t)(tid) + 1) << 4)
+
+static int by_seq(const void *a, const void *b)
+{
+    const mtrace_rec_t *x = a, *y = b;
+
+    return (x->seq > y->seq) - (x->seq < y->seq);
+}
+
+/*
+ * read_log - Read all the records of a recording
+ */
+static mtrace_rec_t *read_log(const char *path, size_t *n)
+{
+    FILE *f;
+    mtrace_hdr_t hdr;
+    mtrace_rec_t *recs;
+    size_t cap = 1 << 16;
+
+    if ((f = fopen(path, "rb")) == NULL)
+        app_error(strerror(errno), path);
+    if (fread(&hdr, sizeof(hdr), 1, f) != 1 || hdr.magic != MTRACE_MAGIC)
+        app_error("not an mtrace recording", path);
+    if (hdr.version != MTRACE_VERSION ||
+        hdr.record_size != sizeof(mtrace_rec_t))
+        app_error("unsupported mtrace version", path);
+
+    recs = xmalloc(cap * sizeof(*recs));
+    *n = 0;
+    for (;;) {
+        if (*n == cap) {
+            cap *= 2;
+            if ((recs = realloc(recs, cap * sizeof(*recs))) == NULL)
+                app_error("out of memory", NULL);
+        }
+        *n += fread(recs + *n, sizeof(*recs), cap - *n, f);
+        if (*n < cap)
+            break;
+    }
+    fclose(f);
+    return recs;
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "Usage: mtrace2rep [-w <weight>] [-o <file.rep>] "
+            "<mtrace.bin>\n");
+    fprintf(stderr, "\t-w <n>     Trace weight (default 1).\n");
+    fprintf(stderr, "\t-o <file>  Write the trace to <file> (default stdout).\n");
+}
+
+int main(int argc, char **argv)
+{
+    mtrace_rec_t *recs, *r;
+    op_t *ops;
+    size_t nrecs, nops = 0, i;
+    int c, id, moved, num_ids = 0, weight = 1;
+    char type;
+    long dropped = 0, races = 0;
+    const char *out = NULL;
+    FILE *f = stdout;
+    map_t live;
+    map_t moving;       /* thread -> id of the block its realloc moves */
+
+    while ((c = getopt(argc, argv, "w:o:h")) != EOF) {
+        switch (c) {
+        case 'w':
+            weight = atoi(optarg);
+            break;
+        case 'o':
+            out = optarg;
+            break;
+        case 'h':
+            usage();
+            exit(0);
+        default:
+            usage();
+            exit(1);
+        }
+    }
+    if (optind != argc - 1) {
+        usage();
+        exit(1);
+    }
+
+    recs = read_log(argv[optind], &nrecs);
+    qsort(recs, nrecs, sizeof(*recs), by_seq);
+
+    /* a record turns into at most two requests */
+    ops = xmalloc(2 * nrecs * sizeof(*ops) + 1);
+    map_init(&live, 1 << 12);
+    map_init(&moving, 1 << 6);
+
+    for (i = 0; i < nrecs; i++) {
+        r = &recs[i];
+        switch (r->op) {
+        case MTRACE_MALLOC:
+        case MTRACE_CALLOC:
+        case MTRACE_MEMALIGN:
+            if ((id = map_find(&live, r->ptr)) >= 0) {
+                ops[nops++] = (op_t){ 'f', id, 0, 0 };
+                races++;
+            }
+            id = num_ids++;
+            map_put(&live, r->ptr, id);
+            ops[nops++] = (op_t){ r->op == MTRACE_MEMALIGN ? 'm' : 'a', id,
+                                  r->size ? r->size : 1, r->arg };
+            break;
+
+        case MTRACE_MOVE:                   /* see MTRACE_REALLOC */
+            if ((id = map_find(&live, r->ptr)) >= 0) {
+                map_remove(&live, r->ptr);
+                map_put(&moving, TID_KEY(r->tid), id);
+            }
+            break;
+
+        case MTRACE_REALLOC:
+            /* a block that moved left live at its MTRACE_MOVE record, and
+               its old address may belong to another block by now */
+            moved = r->size != 0 && r->arg != 0 && r->ptr != r->arg;
+            if (moved) {
+                id = map_find(&moving, TID_KEY(r->tid));
+                map_remove(&moving, TID_KEY(r->tid));
+            } else {
+                id = r->arg ? map_find(&live, r->arg) : -1;
+            }
+            if (r->size == 0) {             /* realloc(p, 0) frees p */
+                if (id >= 0) {
+                    map_remove(&live, r->arg);
+                    ops[nops++] = (op_t){ 'f', id, 0, 0 };
+                } else {
+                    dropped++;
+                }
+                break;
+            }
+            type = 'r';
+            if (id >= 0) {
+                if (!moved)
+                    map_remove(&live, r->arg);
+            } else {                        /* really a malloc */
+                if (r->arg)
+                    dropped++;
+                id = num_ids++;
+                type = 'a';
+            }
+            if (map_find(&live, r->ptr) >= 0) {
+                ops[nops++] = (op_t){ 'f', map_find(&live, r->ptr), 0, 0 };
+                races++;
+            }
+            map_put(&live, r->ptr, id);
+            ops[nops++] = (op_t){ type, id, r->size, 0 };
+            break;
+
+        case MTRACE_FREE:
+            if ((id = map_find(&live, r->ptr)) < 0) {
+                dropped++;
+                break;
+            }
+            map_remove(&live, r->ptr);
+            ops[nops++] = (op_t){ 'f', id, 0, 0 };
+            break;
+
+        default:
+            app_error("corrupt record in", argv[optind]);
+        }
+    }
+
+    if (out != NULL && (f = fopen(out, "w")) == NULL)
+        app_error(strerror(errno), out);
+    fprintf(f, "%d\n%d\n%zu\n0\n", weight, num_ids, nops);
+    for (i = 0; i < nops; i++) {
+        switch (ops[i].type) {
+        case 'f':
+            fprintf(f, "f %d\n", ops[i].id);
+            break;
+        case 'm':
+            fprintf(f, "m %d %zu %zu\n", ops[i].id, ops[i].align, ops[i].size);
+            break;
+        default:
+            fprintf(f, "%c %d %zu\n", ops[i].type, ops[i].id, ops[i].size);
+        }
+    }
+    if (f != stdout)
+        fclose(f);
+
+    fprintf(stderr, "%zu records, %d blocks, %zu requests", nrecs, num_ids,
+            nops);
+    if (dropped)
+        fprintf(stderr, ", %ld calls on unknown blocks dropped", dropped);
+    if (races)
+        fprintf(stderr, ", %ld reordered frees", races);
+    fprintf(stderr, "\n");
+    return 0;
+}
@@ -0,0 +1,173 @@
+/*
+ * perfctr.c - Count hardware events around a function with perf_event_open
+ *
+ * Each event gets its own (ungrouped) counter so that a missing event,
+ * which is common inside containers and VMs, does not take the others
+ * down with it. Counters measure user-level events of the calling
+ * thread only. If there are more events than hardware counters, the
+ * kernel time-shares them and perfctr_stop scales the counts up.
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#endif
+
+#include "perfctr.h"
+
+/* An event we would like to count */
+typedef struct {
+    const char *name;            /* column name used by the driver */
+    unsigned int type;           /* perf_event_attr.type */
+    unsigned long long config;   /* perf_event_attr.config */
+} event_t;
+
+#ifdef __linux__
+
+#define CACHE_EVENT(cache, op, result) \
+    ((cache) | ((op) << 8) | ((result) << 16))
+
+static const event_t events[PERFCTR_NUM] = {
+    { "insn/op", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+    { "cyc/op", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+    { "brmiss/op", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+    { "dTLB/op", PERF_TYPE_HW_CACHE,
+      CACHE_EVENT(PERF_COUNT_HW_CACHE_DTLB, PERF_COUNT_HW_CACHE_OP_READ,
+                  PERF_COUNT_HW_CACHE_RESULT_MISS) },
+    { "L1d/op", PERF_TYPE_HW_CACHE,
+      CACHE_EVENT(PERF_COUNT_HW_CACHE_L1D, PERF_COUNT_HW_CACHE_OP_READ,
+                  PERF_COUNT_HW_CACHE_RESULT_MISS) },
+    { "LLC/op", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+};
+
+static int fds[PERFCTR_NUM];
+static int errs[PERFCTR_NUM];    /* errno from opening each counter */
+static int initialized = 0;
+
+/* 
+ * open_event - open a counter for event e on this thread, or return -1 
+ */
+static int open_event(const event_t *e)
+{
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = e->type;
+    attr.config = e->config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED |
+        PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+    return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+int perfctr_init(void)
+{
+    int i, n = 0;
+
+    if (initialized) {
+        for (i = 0; i < PERFCTR_NUM; i++)
+            n += (fds[i] >= 0);
+        return n;
+    }
+    for (i = 0; i < PERFCTR_NUM; i++) {
+        fds[i] = open_event(&events[i]);
+        errs[i] = (fds[i] >= 0) ? 0 : errno;
+        n += (fds[i] >= 0);
+    }
+    initialized = 1;
+    return n;
+}
+
+void perfctr_fini(void)
+{
+    int i;
+
+    if (!initialized)
+        return;
+    for (i = 0; i < PERFCTR_NUM; i++)
+        if (fds[i] >= 0)
+            close(fds[i]);
+    initialized = 0;
+}
+
+int perfctr_ok(int i)
+{
+    return initialized && fds[i] >= 0;
+}
+
+int perfctr_error(int i)
+{
+    return initialized ? errs[i] : ENODEV;
+}
+
+const char *perfctr_name(int i)
+{
+    return events[i].name;
+}
+
+void perfctr_start(void)
+{
+    int i;
+
+    for (i = 0; i < PERFCTR_NUM; i++) {
+        if (perfctr_ok(i)) {
+            ioctl(fds[i], PERF_EVENT_IOC_RESET, 0);
+            ioctl(fds[i], PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+}
+
+void perfctr_stop(double *vals)
+{
+    unsigned long long buf[3]; /* value, time enabled, time running */
+    int i;
+
+    for (i = 0; i < PERFCTR_NUM; i++) {
+        vals[i] = -1;
+        if (!perfctr_ok(i))
+            continue;
+        ioctl(fds[i], PERF_EVENT_IOC_DISABLE, 0);
+        if (read(fds[i], buf, sizeof(buf)) != sizeof(buf) || buf[2] == 0)
+            continue;
+        vals[i] = (double)buf[0];
+        if (buf[2] < buf[1])
+            vals[i] *= (double)buf[1] / (double)buf[2];
+    }
+}
+
+#else /* !__linux__ */
+
+/* No perf_event_open here: every event is unavailable */
+static const event_t events[PERFCTR_NUM] = {
+    { "insn/op", 0, 0 },
+    { "cyc/op", 0, 0 },
+    { "brmiss/op", 0, 0 },
+    { "dTLB/op", 0, 0 },
+    { "L1d/op", 0, 0 },
+    { "LLC/op", 0, 0 },
+};
+
+int perfctr_init(void) { return 0; }
+void perfctr_fini(void) { }
+int perfctr_ok(int i __attribute__((unused))) { return 0; }
+int perfctr_error(int i __attribute__((unused))) { return ENOSYS; }
+const char *perfctr_name(int i) { return events[i].name; }
+void perfctr_start(void) { }
+
+void perfctr_stop(double *vals)
+{
+    int i;
+    for (i = 0; i < PERFCTR_NUM; i++)
+        vals[i] = -1;
+}
+
+#endif /* __linux__ */
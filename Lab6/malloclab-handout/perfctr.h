@@ -0,0 +1,54 @@
+/*
+ * perfctr.h - prototypes for the routines in perfctr.c that count
+ *     hardware events (via perf_event_open) around a test function
+ */
+
+/* The events the driver knows how to count */
+#define PERFCTR_INSNS      0   /* instructions retired */
+#define PERFCTR_CYCLES     1   /* CPU cycles */
+#define PERFCTR_BR_MISS    2   /* mispredicted branches */
+#define PERFCTR_DTLB_MISS  3   /* data TLB read misses */
+#define PERFCTR_L1D_MISS   4   /* L1 data cache read misses */
+#define PERFCTR_LLC_MISS   5   /* last level cache misses */
+#define PERFCTR_NUM        6   /* number of events above */
+
+/* 
+ * perfctr_init - Open one counter per event for the calling thread.
+ *     Returns the number of counters that could be opened; events the
+ *     kernel or container refuses are simply left unavailable.
+ */
+int perfctr_init(void);
+
+/* 
+ * perfctr_fini - Close the counters. A forked child must do this and call
+ *     perfctr_init again: the counters it inherits count its parent.
+ */
+void perfctr_fini(void);
+
+/* 
+ * perfctr_ok - Is the counter for event i available?
+ */
+int perfctr_ok(int i);
+
+/* 
+ * perfctr_error - Why the counter for event i could not be opened (an
+ *     errno value), or 0 if it is available
+ */
+int perfctr_error(int i);
+
+/* 
+ * perfctr_name - Short column name for event i
+ */
+const char *perfctr_name(int i);
+
+/* 
+ * perfctr_start - Reset and enable all available counters
+ */
+void perfctr_start(void);
+
+/* 
+ * perfctr_stop - Disable the counters and store the event counts in
+ *     vals[0..PERFCTR_NUM-1], or -1 for events that are unavailable.
+ *     Counts are scaled up if the kernel had to multiplex them.
+ */
+void perfctr_stop(double *vals);
@@ -0,0 +1,224 @@
+/*
+ * region.c - A region (arena) allocator layered on malloc
+ *
+ * A region is a list of chunks obtained from malloc, newest first, and
+ * a bump pointer into the newest one. Allocation is a pointer increment;
+ * when a request does not fit, a new chunk is fetched. Chunk sizes double
+ * from REGION_CHUNK up to REGION_MAX_CHUNK, so a region that is reset and
+ * refilled settles on a single large chunk. Requests bigger than a
+ * quarter of the next chunk get a chunk of their own, linked in behind
+ * the current one so that its free space is not thrown away.
+ *
+ * Nested regions hang off their parent's child list and die with it.
+ */
+#include <stdint.h>
+#include <string.h>
+
+#include "mm.h"
+#include "region.h"
+
+#ifdef DRIVER
+/* allocate from the mm package under test, like mm.c itself */
+#define malloc mm_malloc
+#define free mm_free
+#endif /* def DRIVER */
+
+/* same alignment as malloc: mm.c's under the driver, else the C library's */
+#ifdef DRIVER
+#ifdef MM_WIDE
+#define REGION_ALIGNMENT 16
+#else
+#define REGION_ALIGNMENT 8
+#endif
+#else
+#define REGION_ALIGNMENT __alignof__(long double)
+#endif
+#define REGION_CHUNK     (1<<12)     /* first chunk size (bytes) */
+#define REGION_MAX_CHUNK (1<<16)     /* largest chunk size we grow to */
+
+/* rounds up to the nearest multiple of REGION_ALIGNMENT */
+#define RALIGN(size) (((size) + (REGION_ALIGNMENT-1)) & \
+                      ~(size_t)(REGION_ALIGNMENT-1))
+
+/* A chunk header; the usable bytes follow it */
+typedef struct chunk {
+    struct chunk *next;   /* next older chunk */
+    size_t size;          /* usable bytes in this chunk */
+} chunk_t;
+
+#define CHUNK_DATA(c) ((char *)((c) + 1))
+
+/* largest request whose rounded size and chunk header do not wrap */
+#define REGION_MAX_SIZE (SIZE_MAX - sizeof(chunk_t) - REGION_ALIGNMENT)
+
+struct region {
+    char *cur;            /* next free byte in the current chunk */
+    char *end;            /* end of the current chunk */
+    chunk_t *chunks;      /* current chunk first, then older ones */
+    size_t next_size;     /* usable size of the next chunk we fetch */
+    region_t *parent;     /* region we are nested in, or NULL */
+    region_t *child;      /* first region nested in us */
+    region_t *sibling;    /* next region nested in our parent */
+};
+
+/*
+ * new_chunk - Fetch a chunk with room for at least size bytes and make
+ *     it the current one. Returns -1 if malloc fails.
+ */
+static int new_chunk(region_t *r, size_t size)
+{
+    chunk_t *c;
+
+    if (size < r->next_size)
+        size = r->next_size;
+    if ((c = malloc(sizeof(chunk_t) + size)) == NULL)
+        return -1;
+    c->size = size;
+    c->next = r->chunks;
+    r->chunks = c;
+    r->cur = CHUNK_DATA(c);
+    r->end = r->cur + c->size;
+    if (r->next_size < REGION_MAX_CHUNK)
+        r->next_size *= 2;
+    return 0;
+}
+
+/*
+ * big_chunk - Give a large request a chunk of its own, linked in behind
+ *     the current chunk so that we keep bumping through that one.
+ */
+static void *big_chunk(region_t *r, size_t size)
+{
+    chunk_t *c;
+
+    if ((c = malloc(sizeof(chunk_t) + size)) == NULL)
+        return NULL;
+    c->size = size;
+    c->next = r->chunks->next;
+    r->chunks->next = c;
+    return CHUNK_DATA(c);
+}
+
+region_t *region_create(region_t *parent)
+{
+    region_t *r;
+
+    if ((r = malloc(sizeof(region_t))) == NULL)
+        return NULL;
+    r->cur = r->end = NULL;
+    r->chunks = NULL;
+    r->next_size = REGION_CHUNK;
+    r->parent = parent;
+    r->child = NULL;
+    r->sibling = NULL;
+    if (parent != NULL) {
+        r->sibling = parent->child;
+        parent->child = r;
+    }
+    return r;
+}
+
+void *region_alloc(region_t *r, size_t size)
+{
+    char *p;
+
+    if (size > REGION_MAX_SIZE)
+        return NULL;
+    size = RALIGN(size ? size : 1);
+    if (size > (size_t)(r->end - r->cur)) {
+        if (r->chunks != NULL && size > r->next_size / 4)
+            return big_chunk(r, size);
+        if (new_chunk(r, size) < 0)
+            return NULL;
+    }
+    p = r->cur;
+    r->cur += size;
+    return p;
+}
+
+void *region_memalign(region_t *r, size_t alignment, size_t size)
+{
+    uintptr_t p;
+
+    if (alignment == 0 || (alignment & (alignment - 1)) != 0)
+        return NULL;
+    if (alignment <= REGION_ALIGNMENT)
+        return region_alloc(r, size);
+    if (alignment > REGION_MAX_SIZE || size > REGION_MAX_SIZE - alignment)
+        return NULL;
+
+    /* round the bump pointer up if the block still fits... */
+    size = RALIGN(size ? size : 1);
+    p = ((uintptr_t)r->cur + alignment - 1) & ~(uintptr_t)(alignment - 1);
+    if (r->chunks != NULL && p <= (uintptr_t)r->end &&
+        size <= (uintptr_t)r->end - p) {
+        r->cur = (char *)(p + size);
+        return (void *)p;
+    }
+
+    /* ...otherwise over-allocate and round up inside the new block */
+    if ((p = (uintptr_t)region_alloc(r, size + alignment)) == 0)
+        return NULL;
+    return (void *)((p + alignment - 1) & ~(uintptr_t)(alignment - 1));
+}
+
+void *region_realloc(region_t *r, void *ptr, size_t oldsize, size_t size)
+{
+    char *newp;
+
+    if (ptr == NULL)
+        return region_alloc(r, size);
+    if (size == 0 || size > REGION_MAX_SIZE)
+        return NULL;
+
+    /* the last block in the current chunk can simply grow or shrink */
+    if ((char *)ptr + RALIGN(oldsize ? oldsize : 1) == r->cur &&
+        RALIGN(size) <= (size_t)(r->end - (char *)ptr)) {
+        r->cur = (char *)ptr + RALIGN(size);
+        return ptr;
+    }
+
+    if ((newp = region_alloc(r, size)) == NULL)
+        return NULL;
+    memcpy(newp, ptr, oldsize < size ? oldsize : size);
+    return newp;
+}
+
+void region_reset(region_t *r)
+{
+    chunk_t *c, *next;
+
+    while (r->child != NULL)
+        region_destroy(r->child);
+
+    if (r->chunks == NULL)
+        return;
+    for (c = r->chunks->next; c != NULL; c = next) {
+        next = c->next;
+        free(c);
+    }
+    r->chunks->next = NULL;
+    r->cur = CHUNK_DATA(r->chunks);
+    r->end = r->cur + r->chunks->size;
+}
+
+void region_destroy(region_t *r)
+{
+    chunk_t *c, *next;
+    region_t **rp;
+
+    while (r->child != NULL)
+        region_destroy(r->child);
+
+    for (c = r->chunks; c != NULL; c = next) {
+        next = c->next;
+        free(c);
+    }
+
+    if (r->parent != NULL) {
+        for (rp = &r->parent->child; *rp != r; rp = &(*rp)->sibling)
+            ;
+        *rp = r->sibling;
+    }
+    free(r);
+}
@@ -0,0 +1,47 @@
+/*
+ * region.h - prototypes for the region (arena) allocator in region.c
+ *
+ * A region hands out memory by bumping a pointer through chunks it gets
+ * from malloc, and gives all of it back at once with region_reset or
+ * region_destroy. Individual blocks are never freed.
+ */
+#include <stddef.h>
+
+typedef struct region region_t;
+
+/*
+ * region_create - Make an empty region. If parent is not NULL the new
+ *     region is nested in it, and is destroyed along with it when the
+ *     parent is reset or destroyed. Returns NULL if malloc fails.
+ */
+region_t *region_create(region_t *parent);
+
+/*
+ * region_alloc - Allocate size bytes, aligned like malloc, from r
+ */
+void *region_alloc(region_t *r, size_t size);
+
+/*
+ * region_memalign - Allocate size bytes aligned to alignment (a power
+ *     of 2) from r
+ */
+void *region_memalign(region_t *r, size_t alignment, size_t size);
+
+/*
+ * region_realloc - Resize ptr, an oldsize byte block from r. The block
+ *     grows in place if it was the last one allocated; otherwise the
+ *     data is copied to a new block and the old one is left unused
+ *     until the region is reset.
+ */
+void *region_realloc(region_t *r, void *ptr, size_t oldsize, size_t size);
+
+/*
+ * region_reset - Release everything allocated from r and destroy its
+ *     nested regions. r keeps its most recent chunk for reuse.
+ */
+void region_reset(region_t *r);
+
+/*
+ * region_destroy - Release r, its memory and its nested regions
+ */
+void region_destroy(region_t *r);
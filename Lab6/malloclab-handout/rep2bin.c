@@ -0,0 +1,136 @@
+/*
+ * rep2bin.c - Convert an mdriver trace to the binary format of btrace.h
+ *
+ * Usage: rep2bin <file.rep> <file.bin>
+ *
+ * mdriver reads either format, telling them apart by the magic number,
+ * so a converted trace can simply take the place of the text one. The
+ * text is read the way mdriver reads it, so that the binary trace
+ * replays the same requests even when the text is slightly malformed: a
+ * number missing from a request keeps its value from an earlier one.
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "btrace.h"
+
+static void app_error(const char *msg, const char *arg)
+{
+    fprintf(stderr, "rep2bin: %s%s%s\n", msg, arg ? ": " : "",
+            arg ? arg : "");
+    exit(1);
+}
+
+/*
+ * put_varint - Append v to f as an unsigned LEB128 varint, returning
+ *     the number of bytes written
+ */
+static size_t put_varint(FILE *f, uint64_t v)
+{
+    size_t n = 1;
+
+    while (v >= 0x80) {
+        putc((int)(v & 0x7f) | 0x80, f);
+        v >>= 7;
+        n++;
+    }
+    putc((int)v, f);
+    return n;
+}
+
+int main(int argc, char **argv)
+{
+    FILE *in, *out;
+    btrace_hdr_t hdr;
+    char type[16];
+    size_t size = 0, align = 0, count = 0, len = 0;
+    long id = 0, prev = 0;
+    int ops = 0;
+
+    if (argc != 3) {
+        fprintf(stderr, "Usage: rep2bin <file.rep> <file.bin>\n");
+        exit(1);
+    }
+    if ((in = fopen(argv[1], "r")) == NULL)
+        app_error(strerror(errno), argv[1]);
+    if ((out = fopen(argv[2], "wb")) == NULL)
+        app_error(strerror(errno), argv[2]);
+
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.magic = BTRACE_MAGIC;
+    hdr.version = BTRACE_VERSION;
+    if (fscanf(in, "%d %d %d %d", &hdr.weight, &hdr.num_ids, &hdr.num_ops,
+               &hdr.ignore_ranges) != 4)
+        app_error("bad trace header in", argv[1]);
+    if (hdr.weight < 0 || hdr.weight > 3 || hdr.num_ids < 0 ||
+        hdr.num_ops < 0 || (hdr.ignore_ranges != 0 && hdr.ignore_ranges != 1))
+        app_error("bad trace header in", argv[1]);
+
+    /* the header goes in once we know the totals */
+    fseek(out, sizeof(hdr), SEEK_SET);
+
+    while (ops < hdr.num_ops && fscanf(in, "%15s", type) == 1) {
+        switch (type[0]) {
+        case 'a':
+        case 'r':
+            fscanf(in, "%ld %zu", &id, &size);
+            putc(type[0] == 'a' ? BTRACE_ALLOC : BTRACE_REALLOC, out);
+            len += 1 + put_varint(out, ZIGZAG(id - prev));
+            len += put_varint(out, size);
+            break;
+        case 'f':
+            fscanf(in, "%ld", &id);
+            putc(BTRACE_FREE, out);
+            len += 1 + put_varint(out, ZIGZAG(id - prev));
+            break;
+        case 'm':
+            fscanf(in, "%ld %zu %zu", &id, &align, &size);
+            if (align == 0 || (align & (align - 1)))
+                app_error("memalign alignment is not a power of 2 in", argv[1]);
+            putc(BTRACE_MEMALIGN, out);
+            len += 1 + put_varint(out, ZIGZAG(id - prev));
+            len += put_varint(out, align);
+            len += put_varint(out, size);
+            break;
+        case 'b':
+            fscanf(in, "%ld %zu %zu", &id, &count, &size);
+            if (count == 0 || id + (long)count > hdr.num_ids)
+                app_error("block id out of range in", argv[1]);
+            putc(BTRACE_BATCH_ALLOC, out);
+            len += 1 + put_varint(out, ZIGZAG(id - prev));
+            len += put_varint(out, count);
+            len += put_varint(out, size);
+            hdr.num_reqs += count - 1;
+            break;
+        case 'B':
+            fscanf(in, "%ld %zu", &id, &count);
+            if (count == 0 || id + (long)count > hdr.num_ids)
+                app_error("block id out of range in", argv[1]);
+            putc(BTRACE_BATCH_FREE, out);
+            len += 1 + put_varint(out, ZIGZAG(id - prev));
+            len += put_varint(out, count);
+            hdr.num_reqs += count - 1;
+            break;
+        default:
+            app_error("bogus request type in", argv[1]);
+        }
+        /* id -1 is the null pointer, which may be freed */
+        if (id >= hdr.num_ids || id < (type[0] == 'f' ? -1 : 0))
+            app_error("block id out of range in", argv[1]);
+        prev = id;
+        ops++;
+        hdr.num_reqs++;
+    }
+    if (ops != hdr.num_ops)
+        app_error("fewer requests than the header says in", argv[1]);
+    fclose(in);
+
+    hdr.data_len = len;
+    fseek(out, 0, SEEK_SET);
+    fwrite(&hdr, sizeof(hdr), 1, out);
+    if (ferror(out) || fclose(out) != 0)
+        app_error(strerror(errno), argv[2]);
+    return 0;
+}
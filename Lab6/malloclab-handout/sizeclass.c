@@ -0,0 +1,398 @@
+/*
+ * sizeclass.c - Choose the allocator's size classes from a workload
+ *
+ * Usage: sizeclass [-k <classes>] [-m <max>] [-t <cost>] [-o <file.h>]
+ *            <trace>...
+ *
+ * Reads mdriver traces (text or binary, see btrace.h) and libmtrace.so
+ * recordings (see mtrace.h), builds the histogram of requested sizes up
+ * to <max> bytes and writes mm_classes.h, the size class table mm.c
+ * uses. mm.c serves a request of up to MM_CLASS_MAX bytes from the
+ * smallest class that holds it, rounding it up to the class size, so
+ * that blocks freed by one request fit the next request of the same
+ * class exactly.
+ *
+ * The rounding wastes the bytes between a request and its class size.
+ * For each number of classes K up to <classes> the bounds that waste
+ * the fewest bytes are found by dynamic programming over the sizes that
+ * occur (a bound is only ever worth putting at one of them). More
+ * classes waste less but split the free blocks over more lists, so that
+ * fewer of them are reused as they are; every class is charged <cost>
+ * of the requested bytes for that, and the K with the lowest total is
+ * written out. Each trace counts the same, whatever its length, as it
+ * does in mdriver's average.
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "btrace.h"
+#include "mtrace.h"
+
+#define GRAIN       8       /* payloads are at least this aligned */
+#define MAX_CLASSES 64      /* mm.c keeps a free list per class */
+#define MAX_LIMIT   8192    /* largest -m */
+
+static double hist[MAX_LIMIT / GRAIN + 1]; /* by size in grains */
+static double file_hist[MAX_LIMIT / GRAIN + 1];
+static double file_total;   /* requests in the current file, all sizes */
+static size_t limit = 1024; /* -m */
+
+static void app_error(const char *msg, const char *arg)
+{
+    fprintf(stderr, "sizeclass: %s%s%s\n", msg, arg ? ": " : "",
+            arg ? arg : "");
+    exit(1);
+}
+
+static void *xmalloc(size_t size)
+{
+    void *p;
+
+    if ((p = malloc(size)) == NULL)
+        app_error("out of memory", NULL);
+    return p;
+}
+
+/*
+ * count - Count n requests of size bytes in the current file
+ */
+static void count(size_t size, double n)
+{
+    file_total += n;
+    if (size > 0 && size <= limit)
+        file_hist[(size + GRAIN - 1) / GRAIN] += n;
+}
+
+/*
+ * get_varint - Decode an unsigned LEB128 varint at *p, no further than end
+ */
+static uint64_t get_varint(const unsigned char **p, const unsigned char *end,
+                           const char *path)
+{
+    uint64_t v = 0;
+    int shift = 0;
+
+    do {
+        if (*p == end || shift > 63)
+            app_error("truncated binary trace", path);
+        v |= (uint64_t)(**p & 0x7f) << shift;
+        shift += 7;
+    } while (*(*p)++ & 0x80);
+    return v;
+}
+
+/*
+ * read_rep - Count the requests of a text trace, read the way mdriver
+ *     reads it: a number missing from a request keeps its earlier value
+ */
+static void read_rep(FILE *f, const char *path)
+{
+    int weight, num_ids, num_ops, ignore, ops = 0;
+    char type[16];
+    long id;
+    size_t size = 0, align, n = 0;
+
+    if (fscanf(f, "%d %d %d %d", &weight, &num_ids, &num_ops, &ignore) != 4)
+        app_error("bad trace header in", path);
+    while (ops < num_ops && fscanf(f, "%15s", type) == 1) {
+        switch (type[0]) {
+        case 'a':
+        case 'r':
+            fscanf(f, "%ld %zu", &id, &size);
+            count(size, 1);
+            break;
+        case 'b':
+            fscanf(f, "%ld %zu %zu", &id, &n, &size);
+            count(size, n);
+            break;
+        case 'm':   /* memalign is never rounded to a class */
+            fscanf(f, "%ld %zu %zu", &id, &align, &size);
+            break;
+        case 'f':
+            fscanf(f, "%ld", &id);
+            break;
+        case 'B':
+            fscanf(f, "%ld %zu", &id, &n);
+            break;
+        default:
+            app_error("bogus request type in", path);
+        }
+        ops++;
+    }
+}
+
+/*
+ * read_bin - Count the requests of a binary trace
+ */
+static void read_bin(FILE *f, const char *path)
+{
+    btrace_hdr_t hdr;
+    unsigned char *data;
+    const unsigned char *p, *end;
+    uint64_t n;
+    int type;
+
+    if (fread(&hdr, sizeof(hdr), 1, f) != 1 ||
+        hdr.version != BTRACE_VERSION)
+        app_error("unsupported binary trace version", path);
+    data = xmalloc(hdr.data_len);
+    if (fread(data, 1, hdr.data_len, f) != hdr.data_len)
+        app_error("truncated binary trace", path);
+
+    for (p = data, end = data + hdr.data_len; p < end; ) {
+        type = *p++;
+        get_varint(&p, end, path);                  /* id */
+        switch (type) {
+        case BTRACE_ALLOC:
+        case BTRACE_REALLOC:
+            count(get_varint(&p, end, path), 1);
+            break;
+        case BTRACE_MEMALIGN:
+            get_varint(&p, end, path);
+            get_varint(&p, end, path);
+            break;
+        case BTRACE_BATCH_ALLOC:
+            n = get_varint(&p, end, path);
+            count(get_varint(&p, end, path), n);
+            break;
+        case BTRACE_BATCH_FREE:
+            get_varint(&p, end, path);
+            break;
+        case BTRACE_FREE:
+            break;
+        default:
+            app_error("bogus request type in", path);
+        }
+    }
+    free(data);
+}
+
+/*
+ * read_log - Count the requests of a libmtrace.so recording. Order does
+ *     not matter for a histogram, so the records are taken as they come.
+ */
+static void read_log(FILE *f, const char *path)
+{
+    mtrace_hdr_t hdr;
+    mtrace_rec_t r;
+
+    if (fread(&hdr, sizeof(hdr), 1, f) != 1 ||
+        hdr.version != MTRACE_VERSION ||
+        hdr.record_size != sizeof(mtrace_rec_t))
+        app_error("unsupported mtrace version", path);
+    while (fread(&r, sizeof(r), 1, f) == 1) {
+        switch (r.op) {
+        case MTRACE_MALLOC:
+        case MTRACE_CALLOC:
+            count(r.size ? r.size : 1, 1);
+            break;
+        case MTRACE_REALLOC:
+            if (r.size)
+                count(r.size, 1);
+            break;
+        }
+    }
+}
+
+/*
+ * read_file - Add the requests of one file to the histogram, each file
+ *     weighing the same
+ */
+static void read_file(const char *path)
+{
+    FILE *f;
+    uint32_t magic = 0;
+    size_t g;
+
+    if ((f = fopen(path, "rb")) == NULL)
+        app_error(strerror(errno), path);
+    memset(file_hist, 0, sizeof(file_hist));
+    file_total = 0;
+
+    fread(&magic, sizeof(magic), 1, f);
+    rewind(f);
+    if (magic == BTRACE_MAGIC)
+        read_bin(f, path);
+    else if (magic == MTRACE_MAGIC)
+        read_log(f, path);
+    else
+        read_rep(f, path);
+    fclose(f);
+
+    if (file_total > 0)
+        for (g = 1; g <= limit / GRAIN; g++)
+            hist[g] += file_hist[g] / file_total;
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "Usage: sizeclass [-k <classes>] [-m <max>] [-t <cost>] "
+            "[-o <file.h>] <trace>...\n");
+    fprintf(stderr, "\t-k <n>     At most <n> classes (default 32, at most %d).\n",
+            MAX_CLASSES);
+    fprintf(stderr, "\t-m <max>   Classes for requests up to <max> bytes "
+            "(default 1024).\n");
+    fprintf(stderr, "\t-t <cost>  Cost of a class, as a share of the bytes "
+            "(default 0.002).\n");
+    fprintf(stderr, "\t-o <file>  Write the header to <file> "
+            "(default stdout).\n");
+    fprintf(stderr, "\t-v         Print the waste for every number of "
+            "classes.\n");
+}
+
+int main(int argc, char **argv)
+{
+    int c, i, j, k, n = 0, best_k, kmax = 32, verbose = 0, col;
+    size_t g, *sizes, bound[MAX_CLASSES];
+    double *cnt, *bytes, *cost, *prev, w, all = 0, total = 0, t = 0.002;
+    double best = 0;
+    int *from;
+    const char *out = NULL;
+    FILE *f = stdout;
+
+    while ((c = getopt(argc, argv, "k:m:t:o:vh")) != EOF) {
+        switch (c) {
+        case 'k':
+            kmax = atoi(optarg);
+            break;
+        case 'm':
+            limit = strtoul(optarg, NULL, 0);
+            break;
+        case 't':
+            t = atof(optarg);
+            break;
+        case 'o':
+            out = optarg;
+            break;
+        case 'v':
+            verbose = 1;
+            break;
+        case 'h':
+            usage();
+            exit(0);
+        default:
+            usage();
+            exit(1);
+        }
+    }
+    if (optind == argc || kmax < 1 || kmax > MAX_CLASSES ||
+        limit < GRAIN || limit > MAX_LIMIT || limit % GRAIN || t < 0) {
+        usage();
+        exit(1);
+    }
+    for (i = optind; i < argc; i++)
+        read_file(argv[i]);
+
+    /* the sizes that occur, with prefix sums of their counts and bytes */
+    sizes = xmalloc((limit / GRAIN + 1) * sizeof(*sizes));
+    cnt = xmalloc((limit / GRAIN + 2) * sizeof(*cnt));
+    bytes = xmalloc((limit / GRAIN + 2) * sizeof(*bytes));
+    cnt[0] = bytes[0] = 0;
+    for (g = 1; g <= limit / GRAIN; g++) {
+        if (hist[g] == 0)
+            continue;
+        sizes[n] = g * GRAIN;
+        cnt[n + 1] = cnt[n] + hist[g];
+        bytes[n + 1] = bytes[n] + hist[g] * g * GRAIN;
+        n++;
+    }
+    if (n == 0)
+        app_error("no requests up to the -m size in the traces", NULL);
+    total = bytes[n];
+    if (kmax > n)
+        kmax = n;
+
+    /*
+     * cost[k * (n+1) + j] is the least waste of sizes[0..j-1] in k
+     * classes, the last ending at sizes[j-1]; from[] is where that last
+     * class starts. Waste of one class over sizes[i..j-1] is its bound
+     * times its requests less their bytes.
+     */
+    cost = xmalloc((size_t)(kmax + 1) * (n + 1) * sizeof(*cost));
+    from = xmalloc((size_t)(kmax + 1) * (n + 1) * sizeof(*from));
+    for (j = 0; j <= n; j++)
+        cost[j] = j ? 1e300 : 0;
+    for (k = 1; k <= kmax; k++) {
+        prev = cost + (size_t)(k - 1) * (n + 1);
+        for (j = 0; j <= n; j++) {
+            double *cur = cost + (size_t)k * (n + 1) + j;
+
+            *cur = j ? 1e300 : 0;
+            from[(size_t)k * (n + 1) + j] = 0;
+            for (i = k - 1; i < j; i++) {
+                w = prev[i] + sizes[j - 1] * (cnt[j] - cnt[i]) -
+                    (bytes[j] - bytes[i]);
+                if (w < *cur) {
+                    *cur = w;
+                    from[(size_t)k * (n + 1) + j] = i;
+                }
+            }
+        }
+    }
+
+    best_k = 1;
+    for (k = 1; k <= kmax; k++) {
+        w = cost[(size_t)k * (n + 1) + n] / total + t * k;
+        if (verbose)
+            fprintf(stderr, "%2d classes: %6.2f%% wasted, cost %.4f\n", k,
+                    100 * cost[(size_t)k * (n + 1) + n] / total, w);
+        if (k == 1 || w < best) {
+            best = w;
+            best_k = k;
+        }
+    }
+    for (k = best_k, j = n; k > 0; k--) {
+        bound[k - 1] = sizes[j - 1];
+        j = from[(size_t)k * (n + 1) + j];
+    }
+    for (g = 1; g <= limit / GRAIN; g++)
+        all += hist[g];
+
+    if (out != NULL && (f = fopen(out, "w")) == NULL)
+        app_error(strerror(errno), out);
+    fprintf(f, "/*\n * mm_classes.h - size classes for mm.c, written by "
+            "sizeclass\n *\n *    ");
+    for (i = 0, col = 7; i < argc; i++) {
+        if (col + 1 + strlen(argv[i]) > 76) {
+            fprintf(f, "\n *        ");
+            col = 10;
+        }
+        col += fprintf(f, " %s", argv[i]);
+    }
+    fprintf(f, "\n *\n * %d classes for requests up to %zu bytes, wasting "
+            "%.2f%% of their bytes.\n */\n", best_k, bound[best_k - 1],
+            100 * cost[(size_t)best_k * (n + 1) + n] / total);
+    fprintf(f, "#define MM_CLASSES     %d\n", best_k);
+    fprintf(f, "#define MM_CLASS_MAX   %zu  /* largest request with a class "
+            "*/\n", bound[best_k - 1]);
+    fprintf(f, "#define MM_CLASS_GRAIN %d    /* request sizes are looked up "
+            "in these units */\n\n", GRAIN);
+    fprintf(f, "/* Largest request of each class */\n");
+    fprintf(f, "static const unsigned short mm_class_size[MM_CLASSES] = {");
+    for (i = 0; i < best_k; i++)
+        fprintf(f, "%s%zu", !i ? "\n    " : i % 10 ? ", " : ",\n    ",
+                bound[i]);
+    fprintf(f, "\n};\n\n");
+    fprintf(f, "/* Class of a request of s bytes, 0 < s <= MM_CLASS_MAX, is\n"
+            " * mm_class_of[(s - 1) / MM_CLASS_GRAIN] */\n");
+    fprintf(f, "static const unsigned char mm_class_of[MM_CLASS_MAX / "
+            "MM_CLASS_GRAIN] = {");
+    for (g = 1, k = 0; g <= bound[best_k - 1] / GRAIN; g++) {
+        while (bound[k] < g * GRAIN)
+            k++;
+        fprintf(f, "%s%d", g == 1 ? "\n    " : (g - 1) % 16 ? ", " : ",\n    ",
+                k);
+    }
+    fprintf(f, "\n};\n");
+    if (f != stdout && fclose(f) != 0)
+        app_error(strerror(errno), out);
+
+    fprintf(stderr, "%d classes up to %zu bytes for %.1f%% of the requests, "
+            "%.2f%% of their bytes wasted\n", best_k, bound[best_k - 1],
+            100 * all / (argc - optind),
+            100 * cost[(size_t)best_k * (n + 1) + n] / total);
+    return 0;
+}
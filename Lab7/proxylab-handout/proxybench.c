@@ -0,0 +1,100 @@
+/* proxybench.c
+ *
+ * Times fetches of files from a running Tiny server, directly and through
+ * a running proxy, using the shared harness in bench/. The harness's
+ * warm-up fetch puts each file in the proxy's cache, so the proxied times
+ * are those of cache hits (files over MAX_OBJECT_SIZE are never cached).
+ * A benchmark's ops are requests, so ns/op is the latency of one fetch.
+ *
+ * usage: ./proxybench [harness flags] <proxy port> <tiny port> [file...]
+ *     (the files default to home.html, csapp.c and godzilla.jpg, from
+ *     the tiny directory; run both servers on localhost)
+ */
+
+#include <stdio.h>
+#include "csapp.h"
+#include "bench.h"
+
+#define ARGS "<proxy port> <tiny port> [file...]"
+
+/* One benchmark: fetching a file, through the proxy or not */
+typedef struct {
+	char *port ; // Port to connect to
+	char request[MAXLINE] ; // Request to send
+} fetch_t ;
+
+static char *default_files[] = {"home.html", "csapp.c", "godzilla.jpg"} ;
+
+/* fetch_bytes() - send f's request, read the whole response and
+ * return its size */
+static size_t fetch_bytes(fetch_t *f) {
+	char buf[MAXBUF] ;
+	size_t total = 0 ;
+	ssize_t n ;
+	rio_t rio ;
+
+	int fd = Open_clientfd("localhost", f->port) ;
+	Rio_writen(fd, f->request, strlen(f->request)) ;
+	Rio_readinitb(&rio, fd) ;
+	while((n = Rio_readnb(&rio, buf, MAXBUF)) > 0) {
+		total += n ;
+	}
+	Close(fd) ;
+	return total ;
+}
+
+/* fetch() - benchmark function: fetch f's file once */
+static void fetch(void *argp) {
+	fetch_t *f = argp ;
+
+	if(fetch_bytes(f) == 0) {
+		app_error("proxybench: empty response; is the server still up?") ;
+	}
+}
+
+/* add_fetch() - register fetching file from tiny, via proxy_port if it
+ * is not NULL */
+static void add_fetch(char *file, char *proxy_port, char *tiny_port) {
+	fetch_t *f = Malloc(sizeof(fetch_t)) ;
+	char *name = Malloc(MAXLINE) ;
+
+	if(proxy_port) {
+		f->port = proxy_port ;
+		sprintf(f->request, "GET http://localhost:%s/%s HTTP/1.0\r\n"
+			"Host: localhost:%s\r\n\r\n", tiny_port, file, tiny_port) ;
+		sprintf(name, "proxy %s", file) ;
+	}
+	else {
+		f->port = tiny_port ;
+		sprintf(f->request, "GET /%s HTTP/1.0\r\n"
+			"Host: localhost:%s\r\n\r\n", file, tiny_port) ;
+		sprintf(name, "direct %s", file) ;
+	}
+
+	if(fetch_bytes(f) == 0) {
+		app_error("proxybench: empty response; are tiny and the proxy running?") ;
+	}
+	bench_add(name, NULL, fetch, f, 1) ;
+}
+
+int main(int argc, char *argv[]) {
+	int i = bench_options(argc, argv, ARGS) ;
+	char **files = default_files ;
+	int nfiles = sizeof(default_files) / sizeof(default_files[0]) ;
+
+	if(argc - i < 2) {
+		bench_usage(argv[0], ARGS) ;
+		exit(1) ;
+	}
+	if(argc - i > 2) {
+		files = argv + i + 2 ;
+		nfiles = argc - i - 2 ;
+	}
+
+	Signal(SIGPIPE, SIG_IGN) ;
+	for(int j = 0 ; j < nfiles ; j++) {
+		add_fetch(files[j], NULL, argv[i + 1]) ;
+		add_fetch(files[j], argv[i], argv[i + 1]) ;
+	}
+	return bench_run() ;
+}
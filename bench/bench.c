@@ -0,0 +1,349 @@
+/*
+ * bench.c - A small benchmark harness shared by the labs
+ *
+ * Samples are taken with the K-best sampler in kbest.c, which the malloc
+ * lab's ftimer.c uses as well. The harness times samples of several
+ * calls when one call is too short for the clock, and reads
+ * CLOCK_MONOTONIC_RAW rather than a cycle counter, so that it runs
+ * unchanged on any Linux box. The cache clearing code is fcyc.c's
+ * clear().
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <getopt.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "bench.h"
+#include "kbest.h"
+
+/* Default values */
+#define K 3                  /* Value of K in K-best scheme */
+#define MAXSAMPLES 20        /* Give up after MAXSAMPLES */
+#define EPSILON 0.01         /* K samples should be EPSILON of each other */
+#define WARMUP 1             /* Untimed runs before sampling */
+#define MINTIME 1e-3         /* A sample lasts at least MINTIME secs */
+#define CACHE_BYTES (1<<19)  /* Cache size when sysconf does not know it */
+#define CACHE_MAX (1<<27)    /* Most bytes read to clear the caches */
+#define CACHE_BLOCK 32       /* Cache block size in bytes */
+#define MAXBENCH 256         /* Most benchmarks a program can register */
+
+typedef struct {
+    const char *name;
+    bench_funct setup;       /* run before each call, or NULL */
+    bench_funct f;
+    void *argp;
+    double ops;              /* units of work per call */
+
+    /* results */
+    int reps;                /* calls per sample */
+    int samples;             /* samples taken */
+    int converged;           /* did the k best agree within epsilon? */
+    double best;             /* fastest call (secs) */
+    double median;           /* median of the k fastest (secs per call) */
+    double spread;           /* half their spread, as a share of median */
+} bench_t;
+
+static bench_t benches[MAXBENCH];
+static int num_benches = 0;
+
+/* Settings from the command line */
+static int kbest = K;
+static int maxsamples = MAXSAMPLES;
+static double epsilon = EPSILON;
+static int warmup = WARMUP;
+static double mintime = MINTIME;
+static int clear_cache = 0;
+static int cpu = -1;                 /* pinned to this CPU, or -1 */
+static char *filter = NULL;          /* run only names containing this */
+static char *outfile = NULL;         /* JSON results */
+
+static int cache_bytes = 0;
+static int cache_block = CACHE_BLOCK;
+static int *cache_buf = NULL;
+
+double bench_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+void bench_add(const char *name, bench_funct setup, bench_funct f,
+               void *argp, double ops)
+{
+    bench_t *b;
+
+    if (num_benches == MAXBENCH) {
+        fprintf(stderr, "bench_add: more than %d benchmarks\n", MAXBENCH);
+        exit(1);
+    }
+    b = &benches[num_benches++];
+    memset(b, 0, sizeof(*b));
+    b->name = name;
+    b->setup = setup;
+    b->f = f;
+    b->argp = argp;
+    b->ops = ops;
+}
+
+/*
+ * clear - Code to clear cache
+ */
+static volatile int sink = 0;
+
+void bench_clear_cache(void)
+{
+    int x = sink;
+    int *cptr, *cend;
+    int incr = cache_block/sizeof(int);
+
+    if (!cache_buf) {
+        long llc = sysconf(_SC_LEVEL3_CACHE_SIZE);
+
+        if (llc <= 0)
+            llc = sysconf(_SC_LEVEL2_CACHE_SIZE);
+        cache_bytes = (llc > 0) ? 2 * llc : CACHE_BYTES;
+        if (cache_bytes > CACHE_MAX)
+            cache_bytes = CACHE_MAX;
+        cache_buf = calloc(1, cache_bytes);
+        if (!cache_buf) {
+            fprintf(stderr, "Fatal error.  Malloc returned null when trying to clear cache\n");
+            exit(1);
+        }
+    }
+    cptr = (int *) cache_buf;
+    cend = cptr + cache_bytes/sizeof(int);
+    while (cptr < cend) {
+        x += *cptr;
+        cptr += incr;
+    }
+    sink = x;
+}
+
+/*
+ * sample - Time reps calls of b, returning the seconds per call
+ */
+static double sample(bench_t *b, int reps)
+{
+    double t0;
+    int i;
+
+    if (clear_cache)
+        bench_clear_cache();
+    if (b->setup) {
+        b->setup(b->argp);
+        t0 = bench_now();
+        b->f(b->argp);
+        return bench_now() - t0;
+    }
+    t0 = bench_now();
+    for (i = 0; i < reps; i++)
+        b->f(b->argp);
+    return (bench_now() - t0) / reps;
+}
+
+/*
+ * run_bench - Warm up, choose the calls per sample and sample b until
+ *     its k fastest samples converge
+ */
+static void run_bench(bench_t *b)
+{
+    double values[kbest], t;
+    kbest_t kb;
+    int i;
+
+    /* warm up, doubling the calls per sample until one lasts mintime;
+       only the first call of a sample would find the caches cleared, so
+       with -c every sample is a single call */
+    b->reps = 1;
+    for (i = 0; i < warmup; i++)
+        sample(b, 1);
+    if (!b->setup && !clear_cache)
+        while ((t = sample(b, b->reps)) * b->reps < mintime && b->reps < (1 << 30))
+            b->reps *= 2;
+
+    kbest_init(&kb, values, kbest, epsilon);
+    for (i = 0; i < maxsamples; i++)
+        if (kbest_add(&kb, sample(b, b->reps)))
+            break;
+
+    b->samples = kb.samples;
+    b->converged = kbest_converged(&kb);
+    b->best = kbest_min(&kb);
+    b->median = kbest_median(&kb);
+    b->spread = kbest_spread(&kb);
+}
+
+/*
+ * pin_cpu - Run on CPU c only, so that samples do not migrate
+ */
+static void pin_cpu(int c)
+{
+    cpu_set_t set;
+
+    CPU_ZERO(&set);
+    CPU_SET(c, &set);
+    if (sched_setaffinity(0, sizeof(set), &set) < 0) {
+        fprintf(stderr, "bench: cannot pin to CPU %d: %s\n", c, strerror(errno));
+        cpu = -1;
+    }
+}
+
+/*
+ * json_string - Write s to f as a JSON string
+ */
+static void json_string(FILE *f, const char *s)
+{
+    fputc('"', f);
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\')
+            fprintf(f, "\\%c", *s);
+        else if ((unsigned char)*s < 0x20)
+            fprintf(f, "\\u%04x", *s);
+        else
+            fputc(*s, f);
+    }
+    fputc('"', f);
+}
+
+/*
+ * write_json - Write the settings and the results of the benchmarks run
+ */
+static int write_json(const char *path)
+{
+    FILE *f = fopen(path, "w");
+    int i, first = 1;
+
+    if (!f) {
+        fprintf(stderr, "bench: cannot write %s: %s\n", path, strerror(errno));
+        return 1;
+    }
+    fprintf(f, "{\"k\": %d, \"epsilon\": %g, \"max_samples\": %d, "
+            "\"warmup\": %d, \"min_time\": %g, \"clear_cache\": %d, "
+            "\"cache_bytes\": %d, \"cpu\": %d, \"benchmarks\": [\n",
+            kbest, epsilon, maxsamples, warmup, mintime, clear_cache,
+            clear_cache ? cache_bytes : 0, cpu);
+    for (i = 0; i < num_benches; i++) {
+        bench_t *b = &benches[i];
+
+        if (b->samples == 0)
+            continue;
+        fprintf(f, "%s  {\"name\": ", first ? "" : ",\n");
+        json_string(f, b->name);
+        fprintf(f, ", \"ops\": %.0f, \"reps\": %d, \"samples\": %d, "
+                "\"converged\": %d, \"best\": %.9f, \"median\": %.9f, "
+                "\"spread\": %.4f, \"ns_per_op\": %.3f, \"mops\": %.3f}",
+                b->ops, b->reps, b->samples, b->converged, b->best,
+                b->median, b->spread, b->median / b->ops * 1e9,
+                b->ops / b->median / 1e6);
+        first = 0;
+    }
+    fprintf(f, "\n]}\n");
+    if (fclose(f) != 0) {
+        fprintf(stderr, "bench: cannot write %s: %s\n", path, strerror(errno));
+        return 1;
+    }
+    return 0;
+}
+
+int bench_run(void)
+{
+    int i;
+
+    if (cpu >= 0)
+        pin_cpu(cpu);
+    if (clear_cache)
+        bench_clear_cache();
+
+    printf("%-32s %6s %5s %12s %12s %6s %12s %9s\n", "benchmark", "reps",
+           "smpl", "best(us)", "median(us)", "spread", "ns/op", "Mops/s");
+    for (i = 0; i < num_benches; i++) {
+        bench_t *b = &benches[i];
+
+        if (filter && !strstr(b->name, filter))
+            continue;
+        run_bench(b);
+        printf("%-32s %6d %4d%c %12.3f %12.3f %5.1f%% %12.3f %9.3f\n",
+               b->name, b->reps, b->samples, b->converged ? ' ' : '*',
+               b->best * 1e6, b->median * 1e6, b->spread * 100,
+               b->median / b->ops * 1e9, b->ops / b->median / 1e6);
+        fflush(stdout);
+    }
+    printf("(* the %d fastest samples did not agree within %g%%)\n",
+           kbest, epsilon * 100);
+
+    return outfile ? write_json(outfile) : 0;
+}
+
+void bench_usage(const char *prog, const char *args)
+{
+    fprintf(stderr, "Usage: %s [-ch] [-k <k>] [-n <n>] [-e <eps>] [-w <n>] "
+            "[-m <usecs>]\n\t[-p <cpu>] [-f <name>] [-o <file>] %s\n",
+            prog, args);
+    fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-k <k>     Value of K in the K-best scheme (default %d).\n", K);
+    fprintf(stderr, "\t-n <n>     Take at most <n> samples (default %d).\n", MAXSAMPLES);
+    fprintf(stderr, "\t-e <eps>   The K best must be within <eps> (default %g).\n", EPSILON);
+    fprintf(stderr, "\t-w <n>     Untimed warm-up runs (default %d).\n", WARMUP);
+    fprintf(stderr, "\t-m <usecs> Shortest sample (default %.0f).\n", MINTIME * 1e6);
+    fprintf(stderr, "\t-c         Clear the caches before each sample.\n");
+    fprintf(stderr, "\t-p <cpu>   Pin the benchmarks to CPU <cpu>.\n");
+    fprintf(stderr, "\t-f <name>  Run only benchmarks whose names contain <name>.\n");
+    fprintf(stderr, "\t-o <file>  Also write the results to <file> as JSON.\n");
+    fprintf(stderr, "\t-h         Print this message.\n");
+}
+
+int bench_options(int argc, char **argv, const char *args)
+{
+    int c;
+
+    while ((c = getopt(argc, argv, "k:n:e:w:m:cp:f:o:h")) != EOF) {
+        switch (c) {
+        case 'k':
+            kbest = atoi(optarg);
+            break;
+        case 'n':
+            maxsamples = atoi(optarg);
+            break;
+        case 'e':
+            epsilon = atof(optarg);
+            break;
+        case 'w':
+            warmup = atoi(optarg);
+            break;
+        case 'm':
+            mintime = atof(optarg) * 1e-6;
+            break;
+        case 'c':
+            clear_cache = 1;
+            break;
+        case 'p':
+            cpu = atoi(optarg);
+            break;
+        case 'f':
+            filter = optarg;
+            break;
+        case 'o':
+            outfile = optarg;
+            break;
+        case 'h':
+            bench_usage(argv[0], args);
+            exit(0);
+        default:
+            bench_usage(argv[0], args);
+            exit(1);
+        }
+    }
+    if (kbest < 1 || maxsamples < kbest || epsilon < 0 || warmup < 0 || cpu < -1) {
+        fprintf(stderr, "%s: need 1 <= k <= samples, eps >= 0, warm-up >= 0 "
+                "and cpu >= 0\n", argv[0]);
+        exit(1);
+    }
+    return optind;
+}
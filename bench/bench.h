@@ -0,0 +1,65 @@
+/*
+ * bench.h - prototypes for the routines in bench.c, a small benchmark
+ *     harness shared by the labs
+ *
+ * A benchmark program registers its benchmarks, hands its command line
+ * to bench_options and calls bench_run:
+ *
+ *     bench_add("copy 4KB", NULL, copy, &buf, 4096);
+ *     i = bench_options(argc, argv, "");
+ *     return bench_run();
+ *
+ * Each benchmark is timed with the K-best scheme of kbest.c: after warm-up
+ * runs, samples are taken until the k fastest are within epsilon of each
+ * other or the sample limit is reached. A sample times enough back-to-back
+ * calls to last a minimum time, so that short functions are measured as
+ * precisely as long ones. See bench_usage for the flags.
+ */
+#ifndef __BENCH_H
+#define __BENCH_H
+
+/* A benchmark or setup function takes a generic pointer as input */
+typedef void (*bench_funct)(void *);
+
+/*
+ * bench_add - Register benchmark name, where one call of f(argp) does ops
+ *     units of work (bytes, requests, elements; anything to report a rate
+ *     in). If setup is not NULL, setup(argp) runs, untimed, before every
+ *     call of f, and each sample is then a single call.
+ */
+void bench_add(const char *name, bench_funct setup, bench_funct f,
+               void *argp, double ops);
+
+/*
+ * bench_options - Parse the harness flags at the front of argv, exiting
+ *     with a usage message (args naming the program's own arguments) on
+ *     errors. Returns the index of the first argument it did not use.
+ */
+int bench_options(int argc, char **argv, const char *args);
+
+/*
+ * bench_usage - Print the usage message and the harness flags
+ */
+void bench_usage(const char *prog, const char *args);
+
+/*
+ * bench_run - Run the registered benchmarks (those matching -f), print a
+ *     table of the results and write them as JSON if -o was given.
+ *     Returns 0, or 1 if the JSON could not be written.
+ */
+int bench_run(void);
+
+/*
+ * bench_clear_cache - Evict the caches by reading a buffer twice the size
+ *     of the last level cache (at most 128 MB); bench_run calls it before
+ *     each sample with -c, and each sample is then a single call.
+ *     Benchmarks can call it themselves, e.g. from a setup function.
+ */
+void bench_clear_cache(void);
+
+/*
+ * bench_now - Seconds on CLOCK_MONOTONIC_RAW, from an arbitrary origin
+ */
+double bench_now(void);
+
+#endif /* __BENCH_H */
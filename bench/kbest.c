@@ -0,0 +1,75 @@
+/*
+ * kbest.c - The K-best sampler of fcyc.c, for any timer
+ *
+ * Timing a function gives times that are only ever too long (an
+ * interrupt, a cache or TLB refill, another process), so the fastest
+ * runs are the ones to trust. We keep the k fastest and stop once they
+ * are within epsilon of each other. The result is their median, which
+ * unlike their minimum is not set by one lucky run. Their spread tells
+ * how well they agree; as they are the minima of many runs rather than
+ * a random sample, it is no confidence interval.
+ */
+#include "kbest.h"
+
+void kbest_init(kbest_t *kb, double *values, int k, double epsilon)
+{
+    kb->values = values;
+    kb->k = k;
+    kb->n = 0;
+    kb->samples = 0;
+    kb->epsilon = epsilon;
+}
+
+int kbest_add(kbest_t *kb, double val)
+{
+    double *values = kb->values;
+    int pos;
+
+    kb->samples++;
+    if (kb->n < kb->k)
+        pos = kb->n++;
+    else if (val < values[kb->k-1])
+        pos = kb->k-1;
+    else
+        return kbest_converged(kb);
+    values[pos] = val;
+
+    /* Insertion sort */
+    while (pos > 0 && values[pos-1] > values[pos]) {
+        double temp = values[pos-1];
+        values[pos-1] = values[pos];
+        values[pos] = temp;
+        pos--;
+    }
+    return kbest_converged(kb);
+}
+
+int kbest_converged(const kbest_t *kb)
+{
+    return kb->n == kb->k &&
+        (1 + kb->epsilon)*kb->values[0] >= kb->values[kb->k-1];
+}
+
+double kbest_min(const kbest_t *kb)
+{
+    return kb->n ? kb->values[0] : 0;
+}
+
+double kbest_median(const kbest_t *kb)
+{
+    int n = kb->n;
+
+    if (n == 0)
+        return 0;
+    return (n % 2) ? kb->values[n/2] :
+        (kb->values[n/2-1] + kb->values[n/2]) / 2;
+}
+
+double kbest_spread(const kbest_t *kb)
+{
+    double median = kbest_median(kb);
+
+    if (median <= 0)
+        return 0;
+    return (kb->values[kb->n-1] - kb->values[0]) / 2 / median;
+}
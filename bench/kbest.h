@@ -0,0 +1,60 @@
+/*
+ * kbest.h - prototypes for the routines in kbest.c, the K-best sampler
+ *     shared by the malloc lab's ftimer.c and the benchmark harness
+ *
+ * The caller times runs and adds each time with kbest_add, which keeps
+ * the k fastest in order and says when they agree within epsilon:
+ *
+ *     double values[k];
+ *     kbest_t kb;
+ *
+ *     kbest_init(&kb, values, k, epsilon);
+ *     for (i = 0; i < maxsamples; i++)
+ *         if (kbest_add(&kb, time_one_run()))
+ *             break;
+ *     t = kbest_median(&kb);
+ */
+#ifndef __KBEST_H
+#define __KBEST_H
+
+typedef struct {
+    double *values;     /* the n fastest so far, fastest first */
+    int k;              /* how many to keep */
+    int n;              /* how many are kept (at most k) */
+    int samples;        /* how many were added */
+    double epsilon;     /* the k fastest must be within this share */
+} kbest_t;
+
+/*
+ * kbest_init - Start sampling into values, which has room for k
+ */
+void kbest_init(kbest_t *kb, double *values, int k, double epsilon);
+
+/*
+ * kbest_add - Add a sample. Returns 1 once the k fastest have converged,
+ *     that is, once the k-th fastest is within epsilon of the fastest.
+ */
+int kbest_add(kbest_t *kb, double val);
+
+/*
+ * kbest_converged - Have the k fastest samples converged?
+ */
+int kbest_converged(const kbest_t *kb);
+
+/*
+ * kbest_min - The fastest sample, or 0 if there are none
+ */
+double kbest_min(const kbest_t *kb);
+
+/*
+ * kbest_median - The median of the fastest samples kept, or 0 if none
+ */
+double kbest_median(const kbest_t *kb);
+
+/*
+ * kbest_spread - Half the distance between the fastest and the slowest
+ *     sample kept, as a share of their median (0 if there are none)
+ */
+double kbest_spread(const kbest_t *kb);
+
+#endif /* __KBEST_H */